@@ -1,483 +1,1286 @@
 #include "ai.h"
 #include "move_gen.h"
+#include "tt.h"
+#include "book.h"
+#include "tb.h"
+#include "bitbase.h"
+#include "util.h"
+#include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
 #include <stdio.h>
 
-int board_threefold(Board *b, char color_to_move)
+// Pure static evaluation in centipawns from White's point of view. Repetitions, mate and
+// stalemate are the search's business: it sees them as repeated keys or nodes without legal moves.
+int evaluate_board(Board *b)
 {
-    char key[512];
-    position_key(b, color_to_move, key, sizeof(key));
-    for (int i = 0; i < b->history_size; i++)
+    // Material and piece-square sums are kept up to date by make_move/undo_move;
+    // blend middlegame and endgame by the remaining material
+    int phase = b->phase < PHASE_MAX ? b->phase : PHASE_MAX;
+    return (b->eval_mg * phase + b->eval_eg * (PHASE_MAX - phase)) / PHASE_MAX;
+}
+
+// Score of a node whose side to move is checkmated. Nearer mates are worth more to the winner.
+static int mated_score(int ply_from_root)
+{
+    return -(MATE_SCORE - ply_from_root);
+}
+
+// Mate and tablebase scores count plies from the root, but a table entry may be found
+// again at another ply: store them counted from the node and convert back on the way out
+static int score_to_tt(int score, int ply_from_root)
+{
+    if (score >= TB_BOUND)
+        return score + ply_from_root;
+    if (score <= -TB_BOUND)
+        return score - ply_from_root;
+    return score;
+}
+
+static int score_from_tt(int score, int ply_from_root)
+{
+    if (score >= TB_BOUND)
+        return score - ply_from_root;
+    if (score <= -TB_BOUND)
+        return score + ply_from_root;
+    return score;
+}
+
+void collect_legal_moves(Board *b, char color, Move *out, int *out_n)
+{
+    generate_legal_moves(b, color_index(color), ~0ULL, 1, out, out_n);
+}
+
+void collect_capture_moves(Board *b, char color, Move *out, int *out_n)
+{
+    // Only include captures (en passant too)
+    int c = color_index(color);
+    LegalMask m;
+    compute_legal_mask(b, c, &m);
+    generate_captures(b, c, &m, out, out_n);
+}
+
+void order_moves(Board *b, Move *moves, int n, char color)
+{
+    // Simple MVV-LVA: 10*victim - attacker, scored in place
+    int val[128] = {['P'] = 100, ['N'] = 320, ['B'] = 330, ['R'] = 500, ['Q'] = 900, ['K'] = 20000};
+    for (int i = 0; i < n; i++)
     {
-        if (strcmp(b->history[i].key, key) == 0)
+        Cell tgt = board_cell(b, moves[i].to_x, moves[i].to_y);
+        int cap = 0;
+        if (tgt.state != 'E' && tgt.state != color)
         {
-            return b->history[i].count >= 3;
+            char attacker = board_cell(b, moves[i].from_x, moves[i].from_y).piece;
+            cap = 10 * val[(int)tgt.piece] - val[(int)attacker];
         }
+        if (moves[i].promo == 'Q')
+            cap += val['Q'] - val['P'];
+        moves[i].score = cap;
+    }
+    // Stable insertion sort, highest score first
+    for (int i = 1; i < n; i++)
+    {
+        Move m = moves[i];
+        int j = i - 1;
+        while (j >= 0 && moves[j].score < m.score)
+        {
+            moves[j + 1] = moves[j];
+            j--;
+        }
+        moves[j + 1] = m;
     }
-    return 0;
 }
 
-double evaluate_board(Board *b, char color_to_move)
+// Can a stored result settle this node without searching it?
+static int tt_cutoff(const TTEntry *e, int depth, int alpha, int beta, int ply_from_root, int *score)
 {
-    const double values[128] = {['P'] = 100, ['N'] = 320, ['B'] = 330, ['R'] = 500, ['Q'] = 900, ['K'] = 20000};
-    double score = 0.0;
+    if (e->depth < depth)
+        return 0;
+    int s = score_from_tt(e->score, ply_from_root);
+    if (e->bound == TT_EXACT ||
+        (e->bound == TT_LOWER && s >= beta) ||
+        (e->bound == TT_UPPER && s <= alpha))
+    {
+        *score = s;
+        return 1;
+    }
+    return 0;
+}
 
-    if (board_threefold(b, color_to_move))
-        return 0.0;
+static int tt_bound(int score, int alpha, int beta)
+{
+    if (score <= alpha)
+        return TT_UPPER;
+    if (score >= beta)
+        return TT_LOWER;
+    return TT_EXACT;
+}
 
-    for (int i = 0; i < 8; i++)
+// Move the hash move (if it is in the list) to the front, keeping the rest in order
+static void hash_move_first(Move *moves, int n, const Move *hm)
+{
+    for (int i = 0; i < n; i++)
     {
-        for (int j = 0; j < 8; j++)
+        if (move_equal(&moves[i], hm))
         {
-            Cell c = b->cells[i][j];
-            if (c.state == 'E' || !c.piece)
-                continue;
-            double v = values[(int)c.piece];
-            if (c.state == 'W')
-                score += v;
-            else
-                score -= v;
+            Move m = moves[i];
+            memmove(&moves[1], &moves[0], sizeof(Move) * i);
+            moves[0] = m;
+            return;
         }
     }
+}
+
+typedef struct
+{
+    Move move;
+    int score; // from the last completed iteration (a bound for all but the best move)
+} RootMove;
 
-    if (board_is_in_check(b, 'B'))
-        score += 50;
-    if (board_is_in_check(b, 'W'))
-        score -= 50;
+// Per-thread search state. Thread 0 searches the caller's board; helpers (Lazy SMP) search
+// private copies and only share the transposition table with it.
+typedef struct
+{
+    int id;
+    Searcher *owner;
+    TTable *tt; // the owner's table for this search
+    char color; // side to move at the root
+    Board board;
+    GameRecord game;
+    RootMove root[256];
+    int root_n;
+    uint64_t nodes; // this thread's nodes, batched into owner->nodes
+    SearchResult result;
+    Move pv_table[MAX_PLY][MAX_PLY]; // triangular PV table: pv_table[ply] is the best line from ply
+    int pv_length[MAX_PLY];
+    Move killers[MAX_PLY][2];      // quiet moves that caused a beta cutoff at this ply
+    int history[2][64][64];        // butterfly table: [color][from][to], raised by quiet cutoffs
+    Move counter_moves[16][64];    // quiet reply that refuted [piece][to] of the previous move
+    unsigned char null_move[MAX_PLY]; // the move into this ply was a null move
+    pthread_t handle;
+} SearchThread;
 
-    if (board_is_checkmate(b, 'B'))
-        score += 1e10;
-    if (board_is_checkmate(b, 'W'))
-        score -= 1e10;
+// One search and its threads. Limits are polled from inside the tree by every thread of
+// the running search. search_position uses a single default instance; tools that run
+// several searches at once give each its own.
+struct Searcher
+{
+    uint64_t nodes;
+    uint64_t node_limit;   // 0 = none
+    long long start_ms;
+    long long deadline_ms; // 0 = none
+    int stop;
+    SearchThread main;
+    SearchThread *helpers;
+    int thread_count;
+    TTable *tt; // private table, NULL = the shared one
+    SearchOptions options;
+};
 
-    return score;
+static Searcher default_searcher = {.main = {.owner = &default_searcher}, .thread_count = 1, .options = {.null_move = 1, .lmr = 1, .aspiration = 1, .endgame_tables = 1}};
+static _Thread_local SearchThread *current = &default_searcher.main;
+
+static inline int search_stopped(void)
+{
+    return __atomic_load_n(&current->owner->stop, __ATOMIC_RELAXED);
 }
 
-void collect_legal_moves(Board *b, char color, Move *out, int *out_n)
+static void count_node(void)
+{
+    if (++current->nodes & 1023)
+        return;
+    Searcher *s = current->owner;
+    uint64_t total = __atomic_add_fetch(&s->nodes, 1024, __ATOMIC_RELAXED);
+    if ((s->node_limit && total >= s->node_limit) || (s->deadline_ms && now_ms() >= s->deadline_ms))
+        searcher_stop(s);
+}
+
+static void update_pv(int ply, const Move *m)
+{
+    SearchThread *t = current;
+    t->pv_table[ply][0] = *m;
+    memcpy(&t->pv_table[ply][1], t->pv_table[ply + 1], sizeof(Move) * t->pv_length[ply + 1]);
+    t->pv_length[ply] = t->pv_length[ply + 1] + 1;
+}
+
+void searcher_stop(Searcher *s)
 {
-    *out_n = 0;
-    for (int i = 0; i < 8; i++)
+    __atomic_store_n(&s->stop, 1, __ATOMIC_RELAXED);
+}
+
+void search_stop(void)
+{
+    searcher_stop(&default_searcher);
+}
+
+void searcher_set_threads(Searcher *s, int n)
+{
+    if (n < 1)
+        n = 1;
+    if (n > MAX_THREADS)
+        n = MAX_THREADS;
+    for (int i = 0; i < s->thread_count - 1; i++)
+        game_free(&s->helpers[i].game);
+    free(s->helpers);
+    s->helpers = NULL;
+    if (n > 1)
     {
-        for (int j = 0; j < 8; j++)
-        {
-            if (b->cells[i][j].state != color)
-                continue;
-            Pos ps[64];
-            int pn = 0, ln = 0;
-            get_available_moves(b, i, j, 1, ps, &pn);
-            Pos leg[64];
-            filter_legal_moves(b, i, j, ps, pn, color, leg, &ln);
-            for (int k = 0; k < ln; k++)
-            {
-                out[*out_n] = (Move){i, j, leg[k].x, leg[k].y};
-                (*out_n)++;
-            }
-        }
+        s->helpers = (SearchThread *)calloc(n - 1, sizeof(SearchThread));
+        if (!s->helpers)
+            n = 1;
     }
+    for (int i = 0; i < n - 1; i++)
+    {
+        s->helpers[i].id = i + 1;
+        s->helpers[i].owner = s;
+        game_init(&s->helpers[i].game);
+    }
+    s->thread_count = n;
 }
 
-void collect_capture_moves(Board *b, char color, Move *out, int *out_n)
+void search_set_threads(int n)
+{
+    searcher_set_threads(&default_searcher, n);
+}
+
+void search_set_contempt(int cp)
+{
+    default_searcher.options.contempt = cp;
+}
+
+void search_new_game(void)
+{
+    searcher_new_game(&default_searcher);
+}
+
+int search_threads(void)
 {
-    *out_n = 0;
-    for (int i = 0; i < 8; i++)
+    return default_searcher.thread_count;
+}
+
+Searcher *searcher_new(int threads)
+{
+    Searcher *s = (Searcher *)calloc(1, sizeof(Searcher));
+    if (!s)
+        return NULL;
+    s->main.owner = s;
+    s->thread_count = 1;
+    s->options = default_searcher.options;
+    searcher_set_threads(s, threads);
+    return s;
+}
+
+void searcher_free(Searcher *s)
+{
+    if (!s)
+        return;
+    searcher_set_threads(s, 1);
+    tt_table_free(s->tt);
+    free(s);
+}
+
+void searcher_set_hash(Searcher *s, size_t mb)
+{
+    tt_table_free(s->tt);
+    s->tt = mb ? tt_table_new(mb) : NULL;
+}
+
+// Forget everything learned in earlier games: the private table and the move-ordering tables
+void searcher_new_game(Searcher *s)
+{
+    if (s->tt)
+        tt_table_clear(s->tt);
+    for (int i = 0; i < s->thread_count; i++)
     {
-        for (int j = 0; j < 8; j++)
-        {
-            if (b->cells[i][j].state != color)
-                continue;
-            Pos ps[64];
-            int pn = 0, ln = 0;
-            get_available_moves(b, i, j, 0, ps, &pn);
-            Pos leg[64];
-            filter_legal_moves(b, i, j, ps, pn, color, leg, &ln);
-            for (int k = 0; k < ln; k++)
-            {
-                // Only include captures
-                Cell target = b->cells[leg[k].x][leg[k].y];
-                if (target.state != 'E' && target.state != color)
-                {
-                    out[*out_n] = (Move){i, j, leg[k].x, leg[k].y};
-                    (*out_n)++;
-                }
-            }
-        }
+        SearchThread *t = i ? &s->helpers[i - 1] : &s->main;
+        memset(t->history, 0, sizeof(t->history));
+        memset(t->counter_moves, 0, sizeof(t->counter_moves));
     }
 }
 
-void order_moves(Board *b, Move *moves, int n, char color)
+void searcher_set_options(Searcher *s, const SearchOptions *options)
 {
-    // Simple MVV-LVA: 10*victim - attacker
-    int val[128] = {['P'] = 100, ['N'] = 320, ['B'] = 330, ['R'] = 500, ['Q'] = 900, ['K'] = 20000};
-    int *scores = (int *)malloc(sizeof(int) * n);
-    for (int i = 0; i < n; i++)
+    s->options = *options;
+}
+
+// Staged move picker. Each stage is generated only once the previous one is used up,
+// and moves come out one at a time, best first within a stage:
+// hash move, good captures, killers, quiet moves, bad captures. Quiescence stops after
+// the good captures.
+enum
+{
+    PICK_HASH,
+    PICK_GEN_CAPTURES,
+    PICK_GOOD_CAPTURES,
+    PICK_KILLERS,
+    PICK_GEN_QUIETS,
+    PICK_QUIETS,
+    PICK_BAD_CAPTURES,
+    PICK_DONE
+};
+
+static const int mvv_value[6] = {100, 320, 330, 500, 900, 20000};
+
+#define HISTORY_MAX 16384
+
+typedef struct
+{
+    Board *b;
+    int color;
+    int stage;
+    int captures_only; // quiescence: nothing after the captures
+    LegalMask mask;
+    Move hash_move;
+    int has_hash_move;
+    Move killers[2];
+    int killer_ok[2]; // killer was legal here and has been returned
+    int killer_i;
+    Move counter_move; // gets a bonus among the quiet moves
+    Move moves[256];   // [0, good_end) good captures, [good_end, capture_end) bad, then quiets
+    int cur, good_end, capture_end, end;
+} MovePicker;
+
+static int is_capture(const Board *b, const Move *m)
+{
+    int to = SQ(m->to_x, m->to_y);
+    return b->squares[to] != NO_PIECE ||
+           (to == b->ep_square && piece_type(b->squares[SQ(m->from_x, m->from_y)]) == PAWN);
+}
+
+// Static exchange evaluation: the material m wins once both sides have captured on its
+// target square with their least valuable piece for as long as it pays. Sliders lined up
+// behind a capturer (x-rays) join in as the pieces in front of them leave. Pins are ignored.
+static int see(Board *b, const Move *m)
+{
+    int from = SQ(m->from_x, m->from_y), to = SQ(m->to_x, m->to_y);
+    int attacker = piece_type(b->squares[from]);
+    int side = piece_color(b->squares[from]);
+    Bitboard occ = board_occupied(b) ^ BIT(from);
+    Bitboard diag = b->pieces[BISHOP] | b->pieces[QUEEN];
+    Bitboard orth = b->pieces[ROOK] | b->pieces[QUEEN];
+    int gain[32], d = 0;
+
+    if (b->squares[to] != NO_PIECE)
+        gain[0] = mvv_value[piece_type(b->squares[to])];
+    else if (to == b->ep_square && attacker == PAWN)
     {
-        Cell tgt = b->cells[moves[i].to_x][moves[i].to_y];
-        int cap = 0;
-        if (tgt.state != 'E' && tgt.state != color)
-        {
-            char attacker = b->cells[moves[i].from_x][moves[i].from_y].piece;
-            cap = 10 * val[(int)tgt.piece] - val[(int)attacker];
-        }
-        scores[i] = cap;
+        gain[0] = mvv_value[PAWN];
+        occ ^= BIT(to + (side == WHITE ? 8 : -8));
     }
-    // sort desc by scores
-    for (int i = 0; i < n; i++)
+    else
+        gain[0] = 0;
+    if (attacker == PAWN && (m->to_x == 0 || m->to_x == 7))
+    {
+        attacker = m->promo ? piece_index(m->promo) : QUEEN;
+        gain[0] += mvv_value[attacker] - mvv_value[PAWN];
+    }
+
+    Bitboard attackers = attackers_to(b, to, occ) & occ;
+    while (d < 31)
     {
-        for (int j = i + 1; j < n; j++)
+        side ^= 1;
+        Bitboard mine = attackers & b->colors[side];
+        if (!mine)
+            break;
+        // Least valuable attacker; a king may only take if nothing defends the square
+        int t = PAWN;
+        while (!(mine & b->pieces[t]))
+            t++;
+        if (t == KING && (attackers & b->colors[!side]))
+            break;
+
+        d++;
+        gain[d] = mvv_value[attacker] - gain[d - 1]; // if the piece just captured is taken back
+        if (-gain[d - 1] < 0 && gain[d] < 0)
         {
-            if (scores[j] > scores[i])
-            {
-                int ts = scores[i];
-                scores[i] = scores[j];
-                scores[j] = ts;
-                Move tm = moves[i];
-                moves[i] = moves[j];
-                moves[j] = tm;
-            }
+            d--; // the side to capture loses either way: the result's sign is settled
+            break;
         }
+        attacker = t;
+        occ ^= BIT(lsb(mine & b->pieces[t]));
+        attackers |= (bishop_attacks_from(to, occ) & diag) | (rook_attacks_from(to, occ) & orth);
+        attackers &= occ;
     }
-    free(scores);
+    // Either side may stop instead of recapturing
+    while (d > 0)
+    {
+        if (-gain[d - 1] > gain[d])
+            gain[d] = -gain[d - 1];
+        gain[d - 1] = -gain[d];
+        d--;
+    }
+    return gain[0];
 }
 
-void make_move(Board *b, int fx, int fy, int tx, int ty, Snapshot *s)
+// A move from the table or the killer slots may come from another position: check it
+static int picker_is_legal(MovePicker *p, const Move *m)
 {
-    s->from = b->cells[fx][fy];
-    s->to = b->cells[tx][ty];
+    int from = SQ(m->from_x, m->from_y), to = SQ(m->to_x, m->to_y);
+    int piece = p->b->squares[from];
+    if (piece == NO_PIECE || piece_color(piece) != p->color)
+        return 0;
+    if (!(legal_targets(p->b, from, &p->mask, 1) & BIT(to)))
+        return 0;
+    int promoting = piece_type(piece) == PAWN && (m->to_x == 0 || m->to_x == 7);
+    if (promoting)
+        return m->promo == 'Q' || m->promo == 'R' || m->promo == 'B' || m->promo == 'N';
+    return m->promo == 0;
+}
 
-    // Save castling rights
-    s->castling_W_K = b->castling_W_K;
-    s->castling_W_Q = b->castling_W_Q;
-    s->castling_B_K = b->castling_B_K;
-    s->castling_B_Q = b->castling_B_Q;
+static void picker_init(MovePicker *p, Board *b, int color, const Move *hash_move, const Move *killers,
+                        const Move *counter_move, int captures_only)
+{
+    p->b = b;
+    p->color = color;
+    p->stage = PICK_HASH;
+    p->captures_only = captures_only;
+    compute_legal_mask(b, color, &p->mask);
+    p->has_hash_move = hash_move && picker_is_legal(p, hash_move) && (!captures_only || is_capture(b, hash_move));
+    if (p->has_hash_move)
+        p->hash_move = *hash_move;
+    p->killers[0] = killers ? killers[0] : (Move){0};
+    p->killers[1] = killers ? killers[1] : (Move){0};
+    p->killer_ok[0] = p->killer_ok[1] = 0;
+    p->killer_i = 0;
+    p->counter_move = counter_move ? *counter_move : (Move){0};
+}
 
-    s->did_castle = 0;
-    s->did_promo = 0;
+// Incremental selection: swap the highest-scored move of [p->cur, end) to the front
+static Move picker_select(MovePicker *p, int end)
+{
+    int best = p->cur;
+    for (int i = p->cur + 1; i < end; i++)
+        if (p->moves[i].score > p->moves[best].score)
+            best = i;
+    Move m = p->moves[best];
+    p->moves[best] = p->moves[p->cur];
+    p->moves[p->cur++] = m;
+    return m;
+}
 
-    char piece = b->cells[fx][fy].piece;
-    char color = b->cells[fx][fy].state;
+static int picker_is_duplicate(const MovePicker *p, const Move *m)
+{
+    return (p->has_hash_move && move_equal(m, &p->hash_move)) ||
+           (p->killer_ok[0] && move_equal(m, &p->killers[0])) ||
+           (p->killer_ok[1] && move_equal(m, &p->killers[1]));
+}
 
-    // Move the piece
-    b->cells[tx][ty] = b->cells[fx][fy];
-    b->cells[fx][fy] = (Cell){'E', 0};
+// Score captures by MVV-LVA and split them: a capture is bad when it loses material by
+// SEE (only possible when the capturer is worth more than its victim)
+static void picker_gen_captures(MovePicker *p)
+{
+    Board *b = p->b;
+    Move caps[256], bad_moves[256];
+    int n = 0, good = 0, bad = 0;
 
-    // Handle castling (king moved 2 files)
-    if (piece == 'K' && abs(ty - fy) == 2)
+    generate_captures(b, p->color, &p->mask, caps, &n);
+    for (int i = 0; i < n; i++)
     {
-        int row = fx;
-        if (ty > fy)
-        { // kingside
-            // rook h -> f
-            b->cells[row][5] = b->cells[row][7];
-            b->cells[row][7] = (Cell){'E', 0};
-            s->did_castle = 1;
-            s->rook_fx = row;
-            s->rook_fy = 7;
-            s->rook_tx = row;
-            s->rook_ty = 5;
-        }
+        if (p->has_hash_move && move_equal(&caps[i], &p->hash_move))
+            continue;
+        int to = SQ(caps[i].to_x, caps[i].to_y);
+        int attacker = piece_type(b->squares[SQ(caps[i].from_x, caps[i].from_y)]);
+        int victim = b->squares[to] != NO_PIECE ? piece_type(b->squares[to]) : PAWN;
+        caps[i].score = 10 * mvv_value[victim] - mvv_value[attacker];
+        if (caps[i].promo == 'Q')
+            caps[i].score += mvv_value[QUEEN] - mvv_value[PAWN];
+        if (mvv_value[attacker] > mvv_value[victim] && !caps[i].promo && see(b, &caps[i]) < 0)
+            bad_moves[bad++] = caps[i];
         else
-        { // queenside
-            // rook a -> d
-            b->cells[row][3] = b->cells[row][0];
-            b->cells[row][0] = (Cell){'E', 0};
-            s->did_castle = -1;
-            s->rook_fx = row;
-            s->rook_fy = 0;
-            s->rook_tx = row;
-            s->rook_ty = 3;
-        }
-        // Revoke castling rights for that side
-        if (color == 'W')
-        {
-            b->castling_W_K = 0;
-            b->castling_W_Q = 0;
-        }
+            p->moves[good++] = caps[i];
+    }
+    memcpy(&p->moves[good], bad_moves, sizeof(Move) * bad);
+    p->cur = 0;
+    p->good_end = good;
+    p->capture_end = good + bad;
+}
+
+static void picker_gen_quiets(MovePicker *p)
+{
+    Move *out = &p->moves[p->capture_end];
+    int n = 0, kept = 0;
+    generate_quiets(p->b, p->color, &p->mask, out, &n);
+    const int(*history)[64] = current->history[p->color];
+    for (int i = 0; i < n; i++)
+    {
+        if (picker_is_duplicate(p, &out[i]))
+            continue;
+        Move *m = &out[kept++];
+        *m = out[i];
+        if (m->promo == 'Q')
+            m->score = 2 * HISTORY_MAX;
+        else if (move_equal(m, &p->counter_move))
+            m->score = HISTORY_MAX;
         else
-        {
-            b->castling_B_K = 0;
-            b->castling_B_Q = 0;
-        }
+            m->score = history[SQ(m->from_x, m->from_y)][SQ(m->to_x, m->to_y)];
     }
+    p->cur = p->capture_end;
+    p->end = p->capture_end + kept;
+}
 
-    // Revoke rights if king/rook moved (non-castling moves)
-    if (piece == 'K')
+// Next move to search, or 0 when every stage is exhausted
+static int picker_next(MovePicker *p, Move *out)
+{
+    switch (p->stage)
     {
-        if (color == 'W')
+    case PICK_HASH:
+        p->stage = PICK_GEN_CAPTURES;
+        if (p->has_hash_move)
         {
-            b->castling_W_K = 0;
-            b->castling_W_Q = 0;
+            *out = p->hash_move;
+            return 1;
         }
-        else
+        /* fall through */
+    case PICK_GEN_CAPTURES:
+        picker_gen_captures(p);
+        p->stage = PICK_GOOD_CAPTURES;
+        /* fall through */
+    case PICK_GOOD_CAPTURES:
+        if (p->cur < p->good_end)
         {
-            b->castling_B_K = 0;
-            b->castling_B_Q = 0;
+            *out = picker_select(p, p->good_end);
+            return 1;
         }
-    }
-    else if (piece == 'R')
-    {
-        if (color == 'W')
+        // Quiescence does not search losing captures at all
+        p->stage = p->captures_only ? PICK_DONE : PICK_KILLERS;
+        return picker_next(p, out);
+    case PICK_KILLERS:
+        while (p->killer_i < 2)
         {
-            if (fx == 7 && fy == 0)
-                b->castling_W_Q = 0;
-            else if (fx == 7 && fy == 7)
-                b->castling_W_K = 0;
+            int k = p->killer_i++;
+            Move *m = &p->killers[k];
+            if (p->has_hash_move && move_equal(m, &p->hash_move))
+                continue;
+            if (k == 1 && p->killer_ok[0] && move_equal(m, &p->killers[0]))
+                continue;
+            if (!is_capture(p->b, m) && picker_is_legal(p, m))
+            {
+                p->killer_ok[k] = 1;
+                *out = *m;
+                return 1;
+            }
         }
-        else
+        p->stage = PICK_GEN_QUIETS;
+        /* fall through */
+    case PICK_GEN_QUIETS:
+        picker_gen_quiets(p);
+        p->stage = PICK_QUIETS;
+        /* fall through */
+    case PICK_QUIETS:
+        if (p->cur < p->end)
         {
-            if (fx == 0 && fy == 0)
-                b->castling_B_Q = 0;
-            else if (fx == 0 && fy == 7)
-                b->castling_B_K = 0;
+            *out = picker_select(p, p->end);
+            return 1;
         }
-    }
-
-    // Handle promotion
-    if (piece == 'P')
-    {
-        if ((color == 'W' && tx == 0) || (color == 'B' && tx == 7))
+        p->cur = p->good_end;
+        p->stage = PICK_BAD_CAPTURES;
+        /* fall through */
+    case PICK_BAD_CAPTURES:
+        if (p->cur < p->capture_end)
         {
-            s->did_promo = 1;
-            s->promo_prev_piece = 'P';
-            b->cells[tx][ty].piece = 'Q';
+            *out = picker_select(p, p->capture_end);
+            return 1;
         }
+        p->stage = PICK_DONE;
+        /* fall through */
+    default:
+        return 0;
     }
 }
 
-void undo_move(Board *b, int fx, int fy, int tx, int ty, Snapshot *s)
+// Saturating update: entries stay within +-HISTORY_MAX however often they are hit
+static void update_history(int *h, int bonus)
+{
+    *h += bonus - *h * abs(bonus) / HISTORY_MAX;
+}
+
+// A quiet move refuted this node: make it a killer, the counter to the previous move,
+// and raise its history while lowering the quiet moves searched before it
+static void update_quiet_stats(Board *b, int color, const Move *m, const Move *prev, const Move *tried, int n_tried,
+                               int depth, int ply)
 {
-    // Undo promotion
-    if (s->did_promo)
+    SearchThread *t = current;
+    Move *k = t->killers[ply];
+    if (!move_equal(m, &k[0]))
     {
-        b->cells[tx][ty].piece = s->promo_prev_piece; // back to pawn
+        k[1] = k[0];
+        k[0] = *m;
     }
-
-    // Undo castling rook move if any
-    if (s->did_castle != 0)
+    if (prev)
     {
-        b->cells[s->rook_fx][s->rook_fy] = b->cells[s->rook_tx][s->rook_ty];
-        b->cells[s->rook_tx][s->rook_ty] = (Cell){'E', 0};
+        int prev_to = SQ(prev->to_x, prev->to_y);
+        t->counter_moves[b->squares[prev_to]][prev_to] = *m;
     }
 
-    // Restore the piece move
-    b->cells[fx][fy] = s->from;
-    b->cells[tx][ty] = s->to;
+    int bonus = depth * depth < 400 ? depth * depth : 400;
+    update_history(&t->history[color][SQ(m->from_x, m->from_y)][SQ(m->to_x, m->to_y)], bonus);
+    for (int i = 0; i < n_tried; i++)
+        update_history(&t->history[color][SQ(tried[i].from_x, tried[i].from_y)][SQ(tried[i].to_x, tried[i].to_y)], -bonus);
+}
 
-    // Restore castling rights
-    b->castling_W_K = s->castling_W_K;
-    b->castling_W_Q = s->castling_W_Q;
-    b->castling_B_K = s->castling_B_K;
-    b->castling_B_Q = s->castling_B_Q;
+// Score of a draw (repetition, stalemate) for the side to move. With contempt the root
+// side values a draw at -contempt, and so does not settle for one against a weaker opponent.
+static int draw_score(const Board *b)
+{
+    int contempt = current->owner->options.contempt;
+    return color_char(b->side) == current->color ? DRAW_SCORE - contempt : DRAW_SCORE + contempt;
 }
 
-// Quiescence search with delta pruning to handle tactical positions
-double quiescence(Board *b, double alpha, double beta, int maximizing, char color_to_move, int ply_from_root)
+// Progress towards mate in a won pawnless ending, for the stronger side: the other king
+// driven to the edge (in KBNK to a corner the bishop covers) and the kings close together.
+// The mate itself is usually far beyond the horizon.
+static int mop_up(const Board *b, int strong)
 {
-    const int MAX_QUIESCE_DEPTH = 10;
-    
-    // Penalize repetitions heavily to avoid tempo moves
-    if (board_threefold(b, color_to_move))
-        return 0.0;
-    
-    // Check for two-fold repetition and discourage it
-    char key[512];
-    position_key(b, color_to_move, key, sizeof(key));
-    int rep_count = 0;
-    for (int i = 0; i < b->history_size; i++)
+    int weak_king = b->king_sq[!strong], strong_king = b->king_sq[strong];
+    int rank = weak_king >> 3, file = weak_king & 7;
+    int edge = (rank < 4 ? 3 - rank : rank - 4) + (file < 4 ? 3 - file : file - 4); // 0 centre .. 6 corner
+    int dr = abs(rank - (strong_king >> 3)), df = abs(file - (strong_king & 7));
+    int score = 20 * edge + 10 * (7 - (dr > df ? dr : df));
+
+    Bitboard bishops = b->pieces[BISHOP] & b->colors[strong];
+    if (bishops && b->pieces[KNIGHT] & b->colors[strong])
     {
-        if (strcmp(b->history[i].key, key) == 0)
-        {
-            rep_count = b->history[i].count;
-            break;
-        }
+        // a8 and h1 share the colour (rank + file even); a1 and h8 the other one
+        int bishop = lsb(bishops);
+        int odd = ((bishop >> 3) + (bishop & 7)) & 1;
+        int near = odd ? (rank + 7 - file < 7 - rank + file ? rank + 7 - file : 7 - rank + file)
+                         : (rank + file < 14 - rank - file ? rank + file : 14 - rank - file);
+        score += 30 * (14 - near);
+    }
+    return score;
+}
+
+// Known result of a bitbase ending for the side to move. Wins keep the evaluation on top,
+// and without pawns to push a mop-up term, so that the search still sees progress.
+static int bitbase_score(Board *b, int wdl)
+{
+    if (wdl == BB_DRAW)
+        return draw_score(b);
+    int eval = evaluate_board(b);
+    if (b->side == BLACK)
+        eval = -eval;
+    int strong = wdl == BB_WIN ? b->side : !b->side;
+    int progress = b->pieces[PAWN] & b->colors[strong] ? 0 : mop_up(b, strong);
+    return wdl == BB_WIN ? KNOWN_WIN_SCORE + eval + progress : -KNOWN_WIN_SCORE + eval - progress;
+}
+
+// Quiescence search with delta pruning to handle tactical positions. Negamax: scores are
+// from the point of view of the side to move.
+int quiescence(Board *b, int alpha, int beta, int ply_from_root)
+{
+    if (ply_from_root < MAX_PLY)
+        current->pv_length[ply_from_root] = 0;
+    count_node();
+    if (search_stopped())
+        return 0;
+
+    // A position repeated inside the search is scored as a draw: whoever can repeat it
+    // could keep doing so
+    if (board_repetitions(b) >= 1)
+        return draw_score(b);
+
+    // Transposition table: quiescence results are stored with depth 0
+    int alpha_orig = alpha;
+    int tt_score;
+    Move hash_move;
+    int has_hash_move = 0;
+    TTEntry tte;
+    if (tt_table_probe(current->tt, b->key, &tte))
+    {
+        if (tt_cutoff(&tte, 0, alpha, beta, ply_from_root, &tt_score))
+            return tt_score;
+        has_hash_move = tt_entry_move(&tte, &hash_move);
     }
-    if (rep_count >= 2)
-        return maximizing ? -50.0 : 50.0; // Penalize repetition
     
+    // Bitbase endings need no search (in check, the evasions still look for mate)
+    int color = b->side;
+    int in_check = board_is_in_check(b, color_char(color));
+    int wdl;
+    if (!in_check && bitbase_loaded() && current->owner->options.endgame_tables && bitbase_probe(b, &wdl))
+        return bitbase_score(b, wdl);
+
     // Stand pat evaluation
-    double stand_pat = evaluate_board(b, color_to_move);
-    
-    // Depth-dependent scoring: reduce score as we go deeper to prefer shorter mates
-    if (stand_pat > 1e9) // Checkmate for white
-        stand_pat -= ply_from_root * 10;
-    else if (stand_pat < -1e9) // Checkmate for black
-        stand_pat += ply_from_root * 10;
+    int stand_pat = evaluate_board(b);
+    if (color == BLACK)
+        stand_pat = -stand_pat;
     
-    if (ply_from_root >= MAX_QUIESCE_DEPTH)
+    // Captures run out on their own; this only keeps the per-ply tables in bounds
+    if (ply_from_root >= MAX_PLY - 1)
         return stand_pat;
     
-    if (maximizing)
+    if (in_check)
     {
+        // No standing pat in check: search every evasion, and none at all is mate
+        stand_pat = -INF_SCORE;
+    }
+    else
+    {
+        // Fail-soft: bounds returned below alpha or above beta are as tight as known, which
+        // lets the root's aspiration windows re-centre on them
         if (stand_pat >= beta)
-            return beta;
+            return stand_pat;
         if (alpha < stand_pat)
             alpha = stand_pat;
+
+        // Delta pruning: skip if not even capturing their best piece can improve the position
+        const int DELTA_MARGIN = 900; // Queen value
+        int best_victim = PAWN;
+        for (int t = QUEEN; t > PAWN; t--)
+        {
+            if (board_pieces(b, !color, t))
+            {
+                best_victim = t;
+                break;
+            }
+        }
+        if (stand_pat + mvv_value[best_victim] + DELTA_MARGIN < alpha)
+            return stand_pat + mvv_value[best_victim] + DELTA_MARGIN;
     }
-    else
+    
+    // Otherwise only captures that do not lose material, in the picker's order
+    MovePicker picker;
+    picker_init(&picker, b, color, has_hash_move ? &hash_move : NULL, NULL, NULL, !in_check);
+    int best_eval = stand_pat;
+    Move best_move, m;
+    int has_best = 0, searched = 0;
+    
+    while (picker_next(&picker, &m))
+    {
+        Snapshot snap;
+        make_move(b, &m, &snap);
+        searched++;
+        
+        int val = -quiescence(b, -beta, -alpha, ply_from_root + 1);
+        
+        undo_move(b, &m, &snap);
+        if (search_stopped())
+            return 0;
+        
+        if (val > best_eval)
+        {
+            best_eval = val;
+            best_move = m;
+            has_best = 1;
+        }
+        if (val > alpha)
+            alpha = val;
+        if (alpha >= beta)
+            break;
+    }
+    if (in_check && searched == 0)
+        return mated_score(ply_from_root);
+    
+    tt_table_store(current->tt, b->key, 0, tt_bound(best_eval, alpha_orig, beta), score_to_tt(best_eval, ply_from_root),
+             has_best ? &best_move : NULL);
+    return best_eval;
+}
+
+// Selectivity. Null-move pruning: if passing the turn and searching R plies shallower
+// still fails high, the node is assumed to fail high. Late move reductions: quiet moves
+// ordered late are searched lmr_table[depth][move number] plies shallower first, and
+// again at full depth only if they beat alpha. lmr_table is filled by lmr_init() from
+// LMR_BASE + log(depth) * log(move number) / LMR_DIVISOR.
+static const int NULL_MOVE_MIN_DEPTH = 3;
+static const int LMR_MIN_DEPTH = 3;
+static const int LMR_MIN_MOVES = 3; // moves searched at full depth before reducing
+static const double LMR_BASE = 0.75;
+static const double LMR_DIVISOR = 2.25;
+static int lmr_table[MAX_PLY][64];
+
+static void lmr_init(void)
+{
+    static int done = 0;
+    if (done)
+        return;
+    for (int d = 1; d < MAX_PLY; d++)
+        for (int m = 1; m < 64; m++)
+            lmr_table[d][m] = (int)(LMR_BASE + log(d) * log(m) / LMR_DIVISOR);
+    done = 1;
+}
+
+void search_init(void)
+{
+    Board scratch;
+    board_init(&scratch); // Zobrist, piece-square and attack tables
+    tt_init();
+    lmr_init();
+}
+
+// Zugzwang guard for null-move pruning: with only king and pawns left (phase_score's
+// material near zero for this side), passing may really be the best move
+static int has_non_pawn_material(const Board *b, int color)
+{
+    return (b->colors[color] & ~(b->pieces[PAWN] | b->pieces[KING])) != 0;
+}
+
+// Principal variation search: the first move gets the full window, the rest a null
+// window that only asks "better than alpha?", re-searched in full when the answer is yes
+int negamax(Board *b, int depth, int alpha, int beta, int ply_from_root)
+{
+    current->pv_length[ply_from_root] = 0;
+    count_node();
+    if (search_stopped())
+        return 0;
+
+    // Any repetition is a draw (see quiescence)
+    if (board_repetitions(b) >= 1)
+        return draw_score(b);
+
+    // Mate distance pruning: nothing found here can beat a mate already proven nearer the root
+    if (ply_from_root > 0)
     {
-        if (stand_pat <= alpha)
+        if (alpha < mated_score(ply_from_root))
+            alpha = mated_score(ply_from_root);
+        if (beta > MATE_SCORE - ply_from_root - 1)
+            beta = MATE_SCORE - ply_from_root - 1;
+        if (alpha >= beta)
             return alpha;
-        if (beta > stand_pat)
-            beta = stand_pat;
     }
     
-    // Only search captures
-    char color = maximizing ? 'W' : 'B';
-    Move moves[256];
-    int n = 0;
-    collect_capture_moves(b, color, moves, &n);
-    order_moves(b, moves, n, color);
+    // Transposition table: cut off on a deep enough bound, otherwise use its move first
+    int alpha_orig = alpha;
+    int tt_score;
+    Move hash_move;
+    int has_hash_move = 0;
+    TTEntry tte;
+    if (tt_table_probe(current->tt, b->key, &tte))
+    {
+        if (ply_from_root > 0 && depth > 0 && tt_cutoff(&tte, depth, alpha, beta, ply_from_root, &tt_score))
+            return tt_score;
+        has_hash_move = tt_entry_move(&tte, &hash_move);
+    }
     
-    // Delta pruning: skip if no capture can improve position
-    const double DELTA_MARGIN = 900.0; // Queen value
-    if (maximizing)
+    // Tablebases, right after the capture or pawn move that brought the material into range
+    // (later the 50-move counter may already matter). Wins and losses are exact results
+    // but only bounds on the score, which still has to find the way to mate.
+    int tb_floor = -INF_SCORE, tb_ceiling = INF_SCORE; // PV nodes keep an uncut result as a bound
+    int tb_pieces = tb_largest() && current->owner->options.endgame_tables ? count_pieces(b) : 0;
+    if (ply_from_root > 0 && tb_pieces && tb_pieces <= tb_largest() && b->rule50 == 0 && !b->castling &&
+        (tb_pieces < tb_largest() || depth >= tb_probe_depth()))
     {
-        if (stand_pat + DELTA_MARGIN < alpha && n > 0)
+        int ok;
+        int wdl = tb_probe_wdl(b, &ok);
+        if (ok)
         {
-            // Check if even best capture can't reach alpha
-            Cell target = b->cells[moves[0].to_x][moves[0].to_y];
-            const double values[128] = {['P'] = 100, ['N'] = 320, ['B'] = 330, ['R'] = 500, ['Q'] = 900};
-            double best_capture_value = (target.state != 'E') ? values[(int)target.piece] : 0;
-            if (stand_pat + best_capture_value + DELTA_MARGIN < alpha)
-                return alpha;
+            // Draws score like any other draw, contempt included. Cursed wins and blessed
+            // losses are draws too, two centipawns towards the side the tables favour.
+            int draw = tb_rule50();
+            int score = wdl < -draw ? -TB_WIN_SCORE + ply_from_root
+                      : wdl > draw  ? TB_WIN_SCORE - ply_from_root
+                                    : draw_score(b) + 2 * wdl * draw;
+            int bound = wdl < -draw ? TT_UPPER : wdl > draw ? TT_LOWER : TT_EXACT;
+            if (bound == TT_EXACT || (bound == TT_LOWER ? score >= beta : score <= alpha))
+            {
+                tt_table_store(current->tt, b->key, depth + 6 < MAX_PLY ? depth + 6 : MAX_PLY - 1, bound, score_to_tt(score, ply_from_root), NULL);
+                return score;
+            }
+            if (beta - alpha > 1)
+            {
+                if (bound == TT_LOWER)
+                {
+                    tb_floor = score;
+                    if (score > alpha)
+                        alpha = score;
+                }
+                else
+                    tb_ceiling = score;
+            }
         }
     }
-    else
+
+    // A bitbase draw is final; wins and losses are still searched for the way to mate
+    int bb_wdl;
+    if (ply_from_root > 0 && bitbase_loaded() && current->owner->options.endgame_tables && bitbase_probe(b, &bb_wdl) &&
+        bb_wdl == BB_DRAW)
+        return draw_score(b);
+
+    if (depth == 0)
+    {
+        // Use quiescence search instead of static evaluation
+        return quiescence(b, alpha, beta, ply_from_root);
+    }
+
+    int color = b->side;
+    int pv_node = beta - alpha > 1;
+    int in_check = b->king_sq[color] != NO_SQUARE && is_square_attacked(b, b->king_sq[color], !color);
+
+    // Null move, not twice in a row and not near mate scores
+    if (!pv_node && !in_check && ply_from_root > 0 && depth >= NULL_MOVE_MIN_DEPTH && current->owner->options.null_move &&
+        !current->null_move[ply_from_root] && has_non_pawn_material(b, color) && abs(beta) < MATE_BOUND)
     {
-        if (stand_pat - DELTA_MARGIN > beta && n > 0)
+        int static_eval = evaluate_board(b);
+        if (color == BLACK)
+            static_eval = -static_eval;
+        if (static_eval >= beta)
         {
-            Cell target = b->cells[moves[0].to_x][moves[0].to_y];
-            const double values[128] = {['P'] = 100, ['N'] = 320, ['B'] = 330, ['R'] = 500, ['Q'] = 900};
-            double best_capture_value = (target.state != 'E') ? values[(int)target.piece] : 0;
-            if (stand_pat - best_capture_value - DELTA_MARGIN > beta)
-                return beta;
+            int r = 2 + depth / 4;
+            Snapshot snap;
+            make_null_move(b, &snap);
+            current->null_move[ply_from_root + 1] = 1;
+            int val = -negamax(b, depth - 1 - r > 0 ? depth - 1 - r : 0, -beta, -beta + 1, ply_from_root + 1);
+            current->null_move[ply_from_root + 1] = 0;
+            undo_null_move(b, &snap);
+            if (search_stopped())
+                return 0;
+            if (val >= beta)
+                return val >= MATE_BOUND ? beta : val; // an unproven mate
         }
     }
-    
-    double best_eval = stand_pat;
-    
-    for (int i = 0; i < n; i++)
+
+    Move prev, *counter = NULL;
+    int has_prev = board_last_move(b, &prev);
+    if (has_prev)
+    {
+        int prev_to = SQ(prev.to_x, prev.to_y);
+        counter = &current->counter_moves[b->squares[prev_to]][prev_to];
+    }
+    MovePicker picker;
+    picker_init(&picker, b, color, has_hash_move ? &hash_move : NULL, current->killers[ply_from_root], counter, 0);
+
+    int best_eval = tb_floor;
+    Move best_local, m;
+    Move quiets_tried[64];
+    int searched = 0, n_quiets = 0;
+
+    while (picker_next(&picker, &m))
     {
+        int quiet = !m.promo && !is_capture(b, &m);
         Snapshot snap;
-        make_move(b, moves[i].from_x, moves[i].from_y, moves[i].to_x, moves[i].to_y, &snap);
-        
-        double val = quiescence(b, alpha, beta, !maximizing, opposite_color(color_to_move), ply_from_root + 1);
-        
-        undo_move(b, moves[i].from_x, moves[i].from_y, moves[i].to_x, moves[i].to_y, &snap);
-        
-        if (maximizing)
+        make_move(b, &m, &snap);
+
+        int val;
+        if (searched++ == 0)
         {
-            if (val > best_eval)
-                best_eval = val;
-            if (val > alpha)
-                alpha = val;
-            if (beta <= alpha)
-                break;
+            best_local = m;
+            val = -negamax(b, depth - 1, -beta, -alpha, ply_from_root + 1);
         }
         else
         {
-            if (val < best_eval)
-                best_eval = val;
-            if (val < beta)
-                beta = val;
-            if (beta <= alpha)
-                break;
+            int r = 0;
+            if (quiet && !in_check && depth >= LMR_MIN_DEPTH && searched > LMR_MIN_MOVES && current->owner->options.lmr &&
+                !is_square_attacked(b, b->king_sq[!color], color))
+            {
+                r = lmr_table[depth][searched < 64 ? searched : 63] - pv_node;
+                if (r > depth - 2)
+                    r = depth - 2;
+                if (r < 0)
+                    r = 0;
+            }
+            val = -negamax(b, depth - 1 - r, -alpha - 1, -alpha, ply_from_root + 1);
+            if (r > 0 && val > alpha)
+                val = -negamax(b, depth - 1, -alpha - 1, -alpha, ply_from_root + 1);
+            if (val > alpha && val < beta)
+                val = -negamax(b, depth - 1, -beta, -alpha, ply_from_root + 1);
         }
+
+        undo_move(b, &m, &snap);
+        if (search_stopped())
+            return 0;
+
+        if (val > best_eval)
+        {
+            best_eval = val;
+            best_local = m;
+        }
+        if (val > alpha)
+        {
+            alpha = val;
+            update_pv(ply_from_root, &m);
+        }
+        if (alpha >= beta)
+        {
+            if (quiet)
+                update_quiet_stats(b, color, &m, has_prev ? &prev : NULL, quiets_tried, n_quiets, depth, ply_from_root);
+            break;
+        }
+        if (quiet && n_quiets < 64)
+            quiets_tried[n_quiets++] = m;
     }
-    
+    if (searched == 0)
+        return in_check ? mated_score(ply_from_root) : draw_score(b);
+    if (best_eval > tb_ceiling)
+        best_eval = tb_ceiling;
+    tt_table_store(current->tt, b->key, depth, tt_bound(best_eval, alpha_orig, beta), score_to_tt(best_eval, ply_from_root), &best_local);
     return best_eval;
 }
 
-double minimax(Board *b, int depth, double alpha, double beta, int maximizing, char color_to_move, Move *best, int ply_from_root)
+// Keep what earlier searches learned about quiet moves, at reduced weight
+static void age_history(SearchThread *t)
 {
-    // Penalize three-fold repetition
-    if (board_threefold(b, color_to_move))
-        return 0.0;
-    
-    // Detect and heavily penalize two-fold repetition to prevent tempo moves
-    char key[512];
-    position_key(b, color_to_move, key, sizeof(key));
-    int rep_count = 0;
-    for (int i = 0; i < b->history_size; i++)
+    int *h = &t->history[0][0][0];
+    for (size_t i = 0; i < sizeof(t->history) / sizeof(int); i++)
+        h[i] /= 2;
+}
+
+static int is_undo_of(const Move *m, const Move *last)
+{
+    return m->from_x == last->to_x && m->from_y == last->to_y &&
+           m->to_x == last->from_x && m->to_y == last->from_y;
+}
+
+// One iteration over the root moves, in the order the previous iteration left them,
+// within the (alpha, beta) aspiration window
+static int search_root(Board *b, RootMove *rm, int n, int depth, int alpha, int beta)
+{
+    SearchThread *t = current;
+    int alpha_orig = alpha;
+    int best_eval = -INF_SCORE;
+
+    t->pv_length[0] = 0;
+    for (int i = 0; i < n; i++)
     {
-        if (strcmp(b->history[i].key, key) == 0)
+        Snapshot snap;
+        make_move(b, &rm[i].move, &snap);
+        int val;
+        if (i == 0)
         {
-            rep_count = b->history[i].count;
-            break;
+            val = -negamax(b, depth - 1, -beta, -alpha, 1);
+        }
+        else
+        {
+            val = -negamax(b, depth - 1, -alpha - 1, -alpha, 1);
+            if (val > alpha && val < beta)
+                val = -negamax(b, depth - 1, -beta, -alpha, 1);
         }
+        undo_move(b, &rm[i].move, &snap);
+        if (search_stopped())
+            return 0;
+
+        rm[i].score = val;
+        if (val > best_eval)
+            best_eval = val;
+        if (val > alpha)
+        {
+            alpha = val;
+            update_pv(0, &rm[i].move);
+        }
+        if (alpha >= beta)
+            break;
     }
-    
-    // Strong penalty for repeating positions
-    if (rep_count >= 2)
+    if (t->pv_length[0] > 0)
+        tt_table_store(t->tt, b->key, depth, tt_bound(best_eval, alpha_orig, beta), best_eval, &t->pv_table[0][0]);
+    return best_eval;
+}
+
+// Stable insertion sort, best score first
+static void sort_root_moves(RootMove *rm, int n)
+{
+    for (int i = 1; i < n; i++)
     {
-        double penalty = maximizing ? -200.0 : 200.0;
-        return penalty;
+        RootMove cur = rm[i];
+        int j = i - 1;
+        while (j >= 0 && cur.score > rm[j].score)
+        {
+            rm[j + 1] = rm[j];
+            j--;
+        }
+        rm[j + 1] = cur;
     }
-    
-    if (depth == 0 || board_is_checkmate(b, 'W') || board_is_checkmate(b, 'B') || board_is_stalemate(b, 'W') || board_is_stalemate(b, 'B'))
+}
+
+// Iterative deepening on one thread: each completed iteration replaces t->result, so a
+// stop at any moment still leaves the best move and PV of the deepest finished depth.
+// Helpers skip some depths so the threads do not all search the same tree in lockstep:
+// helper i works through the depths in runs of SKIP_SIZE, searching every other run and
+// starting at a phase of its own, so at any moment the helpers are spread over several
+// depths ahead of the main thread.
+//
+// From depth ASPIRATION_DEPTH on, an iteration first searches a narrow window around the
+// previous score and widens the failing side (doubling the margin) until the score
+// lands inside it.
+static const int SKIP_SIZE[20] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+static const int SKIP_PHASE[20] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+static int helper_skips(int id, int depth)
+{
+    if (id == 0)
+        return 0;
+    int i = (id - 1) % 20;
+    return ((depth + SKIP_PHASE[i]) / SKIP_SIZE[i]) & 1;
+}
+
+static void iterate(SearchThread *t, Board *b, int max_depth, const SearchLimits *limits)
+{
+    const int ASPIRATION_DEPTH = 4;
+    const int ASPIRATION_WINDOW = 25;
+    int prev_score = 0;
+
+    current = t;
+    for (int depth = 1; depth <= max_depth; depth++)
     {
-        // Use quiescence search instead of static evaluation
-        return quiescence(b, alpha, beta, maximizing, color_to_move, ply_from_root);
+        if (helper_skips(t->id, depth))
+            continue;
+        int delta = ASPIRATION_WINDOW;
+        int alpha = -INF_SCORE, beta = INF_SCORE;
+        if (depth >= ASPIRATION_DEPTH && t->owner->options.aspiration && abs(prev_score) < MATE_BOUND)
+        {
+            alpha = prev_score - delta;
+            beta = prev_score + delta;
+        }
+
+        int score;
+        while (1)
+        {
+            score = search_root(b, t->root, t->root_n, depth, alpha, beta);
+            if (search_stopped())
+                break;
+            sort_root_moves(t->root, t->root_n);
+            if (score <= alpha)
+                alpha = score - delta;
+            else if (score >= beta)
+                beta = score + delta;
+            else
+                break;
+            delta *= 2;
+            if (delta > 1000)
+                alpha = -INF_SCORE, beta = INF_SCORE;
+        }
+        if (search_stopped())
+            break; // partial iteration: keep the previous one
+
+        prev_score = score;
+        t->result.best = t->pv_table[0][0];
+        t->result.score = t->color == 'W' ? score : -score;
+        t->result.depth = depth;
+        t->result.pv_length = t->pv_length[0];
+        memcpy(t->result.pv, t->pv_table[0], sizeof(Move) * t->pv_length[0]);
+        if (t->id == 0 && limits->report)
+        {
+            t->result.nodes = __atomic_load_n(&t->owner->nodes, __ATOMIC_RELAXED) + (t->nodes & 1023);
+            t->result.time_ms = now_ms() - t->owner->start_ms;
+            limits->report(&t->result, limits->ctx);
+        }
+
+        // The next iteration costs several times this one: past the soft limit, do not
+        // start what probably cannot finish
+        if (t->id == 0 && limits->soft_ms && now_ms() - t->owner->start_ms > limits->soft_ms)
+            break;
     }
+}
+
+static void *helper_main(void *arg)
+{
+    SearchThread *t = (SearchThread *)arg;
+    const SearchLimits until_stopped = {.depth = 0}; // the main thread stops the helpers
+    iterate(t, &t->board, MAX_PLY - 1, &until_stopped);
+    return NULL;
+}
+
+int searcher_search(Searcher *s, Board *b, char color, const SearchLimits *limits, SearchResult *result)
+{
+    memset(result, 0, sizeof(*result));
 
-    char color = maximizing ? 'W' : 'B';
     Move moves[256];
     int n = 0;
     collect_legal_moves(b, color, moves, &n);
-    order_moves(b, moves, n, color);
     if (n == 0)
-        return quiescence(b, alpha, beta, maximizing, color_to_move, ply_from_root);
+        return 0;
 
-    double best_eval = maximizing ? -INFINITY : INFINITY;
-    Move best_local = moves[0];
+    s->nodes = 0;
+    s->node_limit = limits->nodes;
+    s->start_ms = now_ms();
+    s->deadline_ms = limits->movetime_ms > 0 ? s->start_ms + limits->movetime_ms : 0;
+    __atomic_store_n(&s->stop, 0, __ATOMIC_RELAXED); // searcher_stop may come from another thread
+    TTable *tt = s->tt ? s->tt : tt_shared();
+    tt_table_new_search(tt);
+    lmr_init();
 
-    for (int i = 0; i < n; i++)
+    // In a tablebase position only the moves keeping the best DTZ result are searched
+    if (tb_largest() && s->options.endgame_tables && count_pieces(b) <= tb_largest() && !b->castling)
     {
-        // Heavily penalize moves that undo the last move (tempo moves)
-        if (ply_from_root == 0 && b->has_last_move &&
-            moves[i].from_x == b->last_to_x && moves[i].from_y == b->last_to_y &&
-            moves[i].to_x == b->last_from_x && moves[i].to_y == b->last_from_y)
+        int ranks[256];
+        if (tb_rank_root_moves(b, moves, n, ranks))
         {
-            // This is an immediate undo move - skip it at root
-            continue;
+            int best_rank = ranks[0], kept = 0;
+            for (int i = 1; i < n; i++)
+                if (ranks[i] > best_rank)
+                    best_rank = ranks[i];
+            for (int i = 0; i < n; i++)
+                if (ranks[i] == best_rank)
+                    moves[kept++] = moves[i];
+            n = kept;
         }
-        
-        Snapshot snap;
-        make_move(b, moves[i].from_x, moves[i].from_y, moves[i].to_x, moves[i].to_y, &snap);
+    }
 
-        double val = minimax(b, depth - 1, alpha, beta, !maximizing, opposite_color(color_to_move), NULL, ply_from_root + 1);
+    // Initial root order: hash move, then MVV-LVA. Moves that undo our last move are
+    // skipped unless nothing else is legal.
+    SearchThread *t = &s->main;
+    order_moves(b, moves, n, color);
+    Move hash_move;
+    TTEntry tte;
+    if (tt_table_probe(tt, b->key, &tte) && tt_entry_move(&tte, &hash_move))
+        hash_move_first(moves, n, &hash_move);
 
-        undo_move(b, moves[i].from_x, moves[i].from_y, moves[i].to_x, moves[i].to_y, &snap);
+    Move last;
+    int has_last_move = board_last_move(b, &last);
+    t->root_n = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (!has_last_move || !is_undo_of(&moves[i], &last))
+            t->root[t->root_n++] = (RootMove){moves[i], 0};
+    }
+    if (t->root_n == 0)
+    {
+        for (int i = 0; i < n; i++)
+            t->root[t->root_n++] = (RootMove){moves[i], 0};
+    }
 
-        if (maximizing)
-        {
-            if (val > best_eval)
-            {
-                best_eval = val;
-                best_local = moves[i];
-            }
-            if (val > alpha)
-                alpha = val;
-            if (beta <= alpha)
-                break;
-        }
-        else
+    // Something to play even if the first iteration is cut short
+    t->color = color;
+    t->tt = tt;
+    t->nodes = 0;
+    memset(t->killers, 0, sizeof(t->killers));
+    age_history(t);
+    memset(&t->result, 0, sizeof(t->result));
+    t->result.best = t->root[0].move;
+    t->result.pv[0] = t->root[0].move;
+    t->result.pv_length = 1;
+
+    int started = 0;
+    for (int i = 0; i < s->thread_count - 1; i++)
+    {
+        SearchThread *h = &s->helpers[i];
+        h->board = *b;
+        h->board.game = NULL;
+        if (b->game)
         {
-            if (val < best_eval)
-            {
-                best_eval = val;
-                best_local = moves[i];
-            }
-            if (val < beta)
-                beta = val;
-            if (beta <= alpha)
-                break;
+            game_copy(&h->game, b->game);
+            h->board.game = &h->game;
         }
+        memcpy(h->root, t->root, sizeof(RootMove) * t->root_n);
+        h->root_n = t->root_n;
+        h->color = color;
+        h->tt = tt;
+        h->nodes = 0;
+        memset(h->killers, 0, sizeof(h->killers));
+        age_history(h);
+        memset(&h->result, 0, sizeof(h->result));
+        if (pthread_create(&h->handle, NULL, helper_main, h) != 0)
+            break;
+        started++;
     }
-    if (best)
-        *best = best_local;
-    return best_eval;
+
+    int max_depth = (limits->depth > 0 && limits->depth < MAX_PLY) ? limits->depth : MAX_PLY - 1;
+    iterate(t, b, max_depth, limits);
+
+    searcher_stop(s);
+    uint64_t nodes = t->nodes;
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(s->helpers[i].handle, NULL);
+        nodes += s->helpers[i].nodes;
+    }
+
+    *result = t->result;
+    result->nodes = nodes;
+    result->time_ms = now_ms() - s->start_ms;
+    return 1;
+}
+
+int search_position(Board *b, char color, const SearchLimits *limits, SearchResult *result)
+{
+    return searcher_search(&default_searcher, b, color, limits, result);
 }
 
 int engine(Board *b, char color, int depth)
@@ -499,21 +1302,25 @@ int engine(Board *b, char color, int depth)
         return 0; // game_over
     }
 
-    // Evaluate each by calling minimax from the next side's perspective
+    // Known openings are answered from the book without searching
     Move best;
-    double score;
-    if (color == 'W')
+    int score = 0;
+    if (book_probe(b, &best))
     {
-        score = minimax(b, depth, -INFINITY, INFINITY, 1, 'W', &best, 0);
+        printf("[AI] Book move\n");
     }
     else
     {
-        score = minimax(b, depth, -INFINITY, INFINITY, 0, 'B', &best, 0);
+        SearchLimits limits = {.depth = depth};
+        SearchResult result;
+        search_position(b, color, &limits, &result);
+        best = result.best;
+        score = result.score;
     }
 
     // Apply best
-    Cell cap = b->cells[best.to_x][best.to_y];
-    board_apply_move(b, best.from_x, best.from_y, best.to_x, best.to_y);
+    Cell cap = board_cell(b, best.to_x, best.to_y);
+    board_play_move(b, &best);
     char from_file = 'a' + best.from_y;
     int from_rank = 8 - best.from_x;
     char to_file = 'a' + best.to_y;
@@ -529,7 +1336,7 @@ int engine(Board *b, char color, int depth)
     }
     else
     {
-        printf("%s moves %c%d \342\206\222 %c%d [eval=%.2f]\n",
+        printf("%s moves %c%d \342\206\222 %c%d [eval=%d]\n",
                (color == 'B') ? "Black" : "White",
                from_file, from_rank, to_file, to_rank, score);
     }
@@ -561,12 +1368,10 @@ int adaptive_depth_by_moves(Board *b, char color)
 
 double phase_score(Board *b)
 {
-    const double val[128] = {['P'] = 1, ['N'] = 3, ['B'] = 3, ['R'] = 5, ['Q'] = 9};
+    const double val[6] = {[PAWN] = 1, [KNIGHT] = 3, [BISHOP] = 3, [ROOK] = 5, [QUEEN] = 9};
     double total = 0;
-    for (int i = 0; i < 8; i++)
-        for (int j = 0; j < 8; j++)
-            if (b->cells[i][j].state != 'E')
-                total += val[(int)b->cells[i][j].piece];
+    for (int t = PAWN; t < KING; t++)
+        total += val[t] * popcount(b->pieces[t]);
     // Normalize: 78 = typical full material (both sides except kings)
     return total / 78.0; // 1.0 = opening, 0.0 = empty board (endgame)
 }
@@ -1,28 +1,84 @@
 #ifndef AI_H
 #define AI_H
 #include "board.h"
+
+#define MAX_PLY 128
+#define MAX_THREADS 64
+
+// Scores are integer centipawns. Checkmate N plies from the root scores MATE_SCORE - N,
+// so |score| >= MATE_BOUND is a mate and its distance is exact.
+#define MATE_SCORE 32000
+#define MATE_BOUND (MATE_SCORE - MAX_PLY)
+#define INF_SCORE 32001 // outside every real score: bounds of the full window
+#define DRAW_SCORE 0
+// Tablebase wins score TB_WIN_SCORE - ply: below every mate, above every evaluation
+#define TB_WIN_SCORE (MATE_BOUND - 1)
+#define TB_BOUND (TB_WIN_SCORE - MAX_PLY)
+// Bitbase wins: KNOWN_WIN_SCORE plus the evaluation, so the search still sees progress
+#define KNOWN_WIN_SCORE 10000
+
+// Result of the last fully completed iteration
 typedef struct
 {
-    Cell to;
-    Cell from;
-    // Extra for full reversibility:
-    int castling_W_K, castling_W_Q, castling_B_K, castling_B_Q;
-    int did_castle;        // 0 no, 1 kingside, -1 queenside
-    int rook_fx, rook_fy;  // rook from (for castling)
-    int rook_tx, rook_ty;  // rook to   (for castling)
-    int did_promo;         // 1 if we promoted a pawn
-    char promo_prev_piece; // original piece before promotion (should be 'P')
-} Snapshot;
-int board_threefold(Board *b, char color_to_move);
-double evaluate_board(Board *b, char color_to_move);
-double quiescence(Board *b, double alpha, double beta, int maximizing_player, char color_to_move, int ply_from_root);
-double minimax(Board *b, int depth, double alpha, double beta, int maximizing_player, char color_to_move, Move *best, int ply_from_root);
+    Move best;
+    int score; // White's point of view, like evaluate_board
+    int depth;
+    Move pv[MAX_PLY];
+    int pv_length;
+    uint64_t nodes;
+    long long time_ms;
+} SearchResult;
+
+// Search limits: a zero field means "no limit" (depth 0 searches until stopped)
+typedef struct
+{
+    int depth;             // deepest iteration to run
+    long long movetime_ms; // wall-clock budget for the whole search
+    long long soft_ms;     // no new iteration starts once this much time has passed
+    uint64_t nodes;        // node budget for the whole search
+    void (*report)(const SearchResult *result, void *ctx); // optional, called after each completed iteration
+    void *ctx;                                             // passed to report as is
+} SearchLimits;
+
+int evaluate_board(Board *b);
+int quiescence(Board *b, int alpha, int beta, int ply_from_root);
+int negamax(Board *b, int depth, int alpha, int beta, int ply_from_root);
 void order_moves(Board *b, Move *moves, int n, char color);
 void collect_capture_moves(Board *b, char color, Move *out, int *out_n);
 void get_attack_squares(Board *b, int x, int y, Pos *out, int *out_count);
 void collect_legal_moves(Board *b, char color, Move *out, int *out_n);
-void make_move(Board *b, int from_x, int from_y, int to_x, int to_y, Snapshot *snap);
-void undo_move(Board *b, int from_x, int from_y, int to_x, int to_y, Snapshot *snap);
+int search_position(Board *b, char color, const SearchLimits *limits, SearchResult *result);
+void search_stop(void);
+void search_set_threads(int n);
+int search_threads(void);
+void search_new_game(void); // searcher_new_game for search_position
+void search_set_contempt(int cp);
+
+// Search features that can be switched off per Searcher, e.g. to measure one in a match.
+// All are on by default.
+typedef struct
+{
+    int null_move;
+    int lmr;            // late move reductions
+    int aspiration;     // aspiration windows at the root
+    int endgame_tables; // Syzygy tablebases and bitbases, when loaded
+    int contempt;       // centipawns a draw is worth less than 0 to the side to move at the root
+} SearchOptions;
+
+// Independent searches for running several at once (batch analysis, matches). Each has its
+// own threads, limits and move-ordering tables; they share the transposition table unless
+// given their own.
+// search_init builds the shared tables first, before the threads could race to do it.
+typedef struct Searcher Searcher;
+void search_init(void);
+Searcher *searcher_new(int threads);
+void searcher_free(Searcher *s);
+void searcher_set_threads(Searcher *s, int n);
+void searcher_set_hash(Searcher *s, size_t mb); // private table of mb MB; 0 = back to the shared one
+void searcher_set_options(Searcher *s, const SearchOptions *options);
+void searcher_new_game(Searcher *s);
+int searcher_search(Searcher *s, Board *b, char color, const SearchLimits *limits, SearchResult *result);
+void searcher_stop(Searcher *s);
 int engine(Board *b, char color, int depth);
 int count_legal_moves(Board *b, char color);
 int adaptive_depth_by_moves(Board *b, char color);
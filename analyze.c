@@ -0,0 +1,214 @@
+#include "analyze.h"
+#include "epd.h"
+#include "move_gen.h"
+#include "tt.h"
+#include "util.h"
+#include <pthread.h>
+
+// Each worker takes the next line of the file under a lock (the file is streamed, never
+// held whole), searches it with its own board, Searcher and transposition table, and
+// prints its result as one JSON line. A shared table would have every search start a new
+// generation of it, ageing out the entries of the searches still running. Lines are
+// printed as they finish, so with several workers the order differs from the input;
+// "line" gives the input line number.
+
+typedef struct
+{
+    FILE *in;
+    long line_no;
+    pthread_mutex_t in_lock;
+    pthread_mutex_t out_lock;
+    SearchLimits limits;
+    int threads_per_worker;
+    size_t hash_mb; // per worker
+    long positions;
+    uint64_t nodes;
+} AnalyzeJob;
+
+// Write s as a JSON string
+static void json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(f, "\\u%04x", *s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void print_result(AnalyzeJob *job, long line_no, EpdPosition *pos, int found, const SearchResult *r)
+{
+    char buf[8];
+    // Scores from the side to move's point of view, like UCI
+    int score = pos->board.side == WHITE ? r->score : -r->score;
+
+    pthread_mutex_lock(&job->out_lock);
+    printf("{\"line\":%ld,", line_no);
+    if (pos->id[0])
+    {
+        printf("\"id\":");
+        json_string(stdout, pos->id);
+        printf(",");
+    }
+    printf("\"fen\":");
+    json_string(stdout, pos->fen);
+    if (!found)
+    {
+        // No legal move: nothing to search
+        int mated = is_square_attacked(&pos->board, pos->board.king_sq[pos->board.side], !pos->board.side);
+        printf(",\"bestmove\":null,\"result\":\"%s\"}\n", mated ? "checkmate" : "stalemate");
+    }
+    else
+    {
+        format_move(&r->best, buf);
+        printf(",\"bestmove\":\"%s\",\"score\":{", buf);
+        if (abs(score) >= MATE_BOUND)
+        {
+            int plies = MATE_SCORE - abs(score);
+            printf("\"mate\":%d}", score > 0 ? (plies + 1) / 2 : -(plies / 2));
+        }
+        else
+            printf("\"cp\":%d}", score);
+        printf(",\"depth\":%d,\"nodes\":%llu,\"time_ms\":%lld,\"pv\":\"", r->depth, (unsigned long long)r->nodes,
+               r->time_ms);
+        for (int i = 0; i < r->pv_length; i++)
+        {
+            format_move(&r->pv[i], buf);
+            printf(i ? " %s" : "%s", buf);
+        }
+        printf("\"}\n");
+    }
+    fflush(stdout);
+    job->positions++;
+    job->nodes += r->nodes;
+    pthread_mutex_unlock(&job->out_lock);
+}
+
+static void *analyze_worker(void *arg)
+{
+    AnalyzeJob *job = (AnalyzeJob *)arg;
+    Searcher *searcher = searcher_new(job->threads_per_worker);
+    if (searcher)
+        searcher_set_hash(searcher, job->hash_mb);
+    GameRecord game;
+    game_init(&game);
+    EpdPosition pos;
+    char line[1024];
+
+    while (searcher)
+    {
+        pthread_mutex_lock(&job->in_lock);
+        char *got = fgets(line, sizeof(line), job->in);
+        long line_no = ++job->line_no;
+        // The rest of an overlong line is not a position of its own
+        if (got && !strchr(line, '\n'))
+        {
+            int c;
+            while ((c = fgetc(job->in)) != EOF && c != '\n')
+                ;
+        }
+        pthread_mutex_unlock(&job->in_lock);
+        if (!got)
+            break;
+        if (!epd_parse(line, &pos))
+        {
+            line[strcspn(line, "\r\n")] = 0;
+            const char *p = line + strspn(line, " \t");
+            if (*p && *p != '#')
+                fprintf(stderr, "line %ld: not a position: %s\n", line_no, line);
+            continue;
+        }
+
+        board_attach_game(&pos.board, &game);
+        SearchResult result;
+        int found = searcher_search(searcher, &pos.board, color_char(pos.board.side), &job->limits, &result);
+        print_result(job, line_no, &pos, found, &result);
+    }
+
+    game_free(&game);
+    searcher_free(searcher);
+    return NULL;
+}
+
+int analyze_file(const char *path, const SearchLimits *limits, int workers, int threads_per_worker, size_t hash_mb)
+{
+    AnalyzeJob job;
+    memset(&job, 0, sizeof(job));
+    job.in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!job.in)
+    {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 0;
+    }
+    job.limits = *limits;
+    job.limits.report = NULL;
+    job.threads_per_worker = threads_per_worker;
+    job.hash_mb = hash_mb > 0 ? hash_mb : 1;
+    pthread_mutex_init(&job.in_lock, NULL);
+    pthread_mutex_init(&job.out_lock, NULL);
+    if (workers < 1)
+        workers = 1;
+    if (workers > MAX_THREADS)
+        workers = MAX_THREADS;
+
+    search_init();
+
+    long long start = now_ms();
+    pthread_t handles[MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < workers; i++)
+    {
+        if (pthread_create(&handles[started], NULL, analyze_worker, &job) != 0)
+            break;
+        started++;
+    }
+    analyze_worker(&job);
+    for (int i = 0; i < started; i++)
+        pthread_join(handles[i], NULL);
+    long long ms = now_ms() - start;
+
+    if (job.in != stdin)
+        fclose(job.in);
+    pthread_mutex_destroy(&job.in_lock);
+    pthread_mutex_destroy(&job.out_lock);
+    fprintf(stderr, "%ld positions, %llu nodes in %lld ms: %.1f positions/s, %.0f nps (%d workers)\n", job.positions,
+            (unsigned long long)job.nodes, ms, ms > 0 ? job.positions * 1000.0 / (double)ms : 0.0,
+            ms > 0 ? (double)job.nodes * 1000.0 / (double)ms : 0.0, started + 1);
+    return 1;
+}
+
+// chess analyze FILE [depth N] [nodes N] [movetime MS] [workers N] [threads N] [hash MB]
+// FILE "-" reads standard input. Without a budget each position is searched to depth 8.
+int analyze_command(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: analyze FILE [depth N] [nodes N] [movetime MS] [workers N] [threads N] [hash MB]\n");
+        return 1;
+    }
+    SearchLimits limits = {.depth = 0};
+    int workers = 1, threads = 1, hash_mb = TT_DEFAULT_MB;
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "depth") == 0)
+            limits.depth = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "nodes") == 0)
+            limits.nodes = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "movetime") == 0)
+            limits.movetime_ms = atoll(argv[i + 1]);
+        else if (strcmp(argv[i], "workers") == 0)
+            workers = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "threads") == 0)
+            threads = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "hash") == 0)
+            hash_mb = atoi(argv[i + 1]);
+    }
+    if (!limits.depth && !limits.nodes && !limits.movetime_ms)
+        limits.depth = 8;
+    return analyze_file(argv[1], &limits, workers, threads, hash_mb > 0 ? (size_t)hash_mb : 1) ? 0 : 1;
+}
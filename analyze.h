@@ -0,0 +1,9 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+#include "ai.h"
+
+// Offline analysis of an EPD/FEN file on a pool of workers, one JSON line per position
+int analyze_file(const char *path, const SearchLimits *limits, int workers, int threads_per_worker, size_t hash_mb);
+int analyze_command(int argc, char **argv);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "bench.h"
+#include "ai.h"
+#include "tt.h"
+#include "util.h"
+
+// Middlegame and endgame positions searched to a fixed depth by every configuration
+static const char *bench_positions[] = {
+    STARTPOS_FEN,
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+};
+
+// Time-to-depth and NPS for each thread count, each run starting from an empty table and
+// fresh move-ordering tables.
+// Speedup is the 1-thread time divided by this configuration's time.
+int bench_smp(int depth, const int *thread_counts, int n_counts)
+{
+    static Board board;
+    GameRecord game;
+    game_init(&game);
+    int saved_threads = search_threads();
+    long long base_ms = 0;
+    uint64_t base_nodes = 0;
+
+    printf("Lazy SMP scaling, depth %d, %d positions\n", depth, (int)(sizeof(bench_positions) / sizeof(bench_positions[0])));
+    printf("%8s %12s %14s %12s %9s %9s\n", "threads", "time (ms)", "nodes", "nps", "speedup", "nps x");
+
+    for (int c = 0; c < n_counts; c++)
+    {
+        search_set_threads(thread_counts[c]);
+        search_new_game();
+        tt_clear();
+        long long ms = 0;
+        uint64_t nodes = 0;
+        for (size_t p = 0; p < sizeof(bench_positions) / sizeof(bench_positions[0]); p++)
+        {
+            board_set_fen(&board, bench_positions[p]);
+            board_attach_game(&board, &game);
+            SearchLimits limits = {.depth = depth};
+            SearchResult result;
+            search_position(&board, color_char(board.side), &limits, &result);
+            ms += result.time_ms;
+            nodes += result.nodes;
+        }
+        if (c == 0)
+        {
+            base_ms = ms;
+            base_nodes = nodes;
+        }
+        double nps = ms > 0 ? (double)nodes * 1000.0 / (double)ms : 0.0;
+        double base_nps = base_ms > 0 ? (double)base_nodes * 1000.0 / (double)base_ms : 0.0;
+        printf("%8d %12lld %14llu %12.0f %8.2fx %8.2fx\n", search_threads(), ms, (unsigned long long)nodes, nps,
+               ms > 0 ? (double)base_ms / (double)ms : 0.0, base_nps > 0 ? nps / base_nps : 0.0);
+    }
+
+    search_set_threads(saved_threads);
+    game_free(&game);
+    return 0;
+}
+
+// chess bench [depth] [threads...]   default: depth 6 at 1 2 4 8 16 threads
+int bench_command(int argc, char **argv)
+{
+    int depth = argc > 1 ? atoi(argv[1]) : 6;
+    if (depth < 1)
+    {
+        printf("usage: bench [depth] [threads...]\n");
+        return 1;
+    }
+    int counts[16] = {1, 2, 4, 8, 16};
+    int n_counts = 5;
+    if (argc > 2)
+    {
+        n_counts = 0;
+        for (int i = 2; i < argc && n_counts < 16; i++)
+            counts[n_counts++] = atoi(argv[i]);
+    }
+    return bench_smp(depth, counts, n_counts);
+}
@@ -0,0 +1,8 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include "board.h"
+
+int bench_smp(int depth, const int *thread_counts, int n_counts);
+int bench_command(int argc, char **argv);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,780 @@
+#include "bitbase.h"
+#include "move_gen.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Every ending is stored from the stronger side's view (it plays White) and indexed by
+// side to move and piece squares, numbered from a1 = 0 like the tablebases: ours ^ 56.
+// Without pawns the board is folded by its 8 symmetries so the strong king stands in the
+// a1-d1-d4 triangle; with pawns only by the a-h mirror, so it stands on files a-d.
+//
+// Generation: a forward pass with the legal move generator scores mates, stalemates and
+// the moves that leave the ending (captures, promotions) from the endings already built.
+// Then, level by level, positions decided in the last level are unmade one move: a
+// predecessor of a loss is a win, and a predecessor of a win is a loss once all of its
+// moves are known to lose. What is never decided is a draw.
+//
+// File: "CBB1", uint32 count, then per ending {char name[8], uint64 offset, uint64 positions}
+// (little-endian), then the 2-bit tables.
+
+#define BB_MAGIC "CBB1"
+#define BB_MAX_THREADS 64
+
+// Generation state per position
+enum
+{
+    ST_UNKNOWN,
+    ST_WIN,
+    ST_LOSS,
+    ST_DRAW,
+    ST_ILLEGAL,
+    ST_VALUE = 7,    // mask of the above
+    ST_CANT_LOSE = 8 // a move out of the ending draws
+};
+
+// Stored values, 2 bits per position
+enum
+{
+    PK_DRAW,
+    PK_WIN,
+    PK_LOSS,
+    PK_ILLEGAL
+};
+
+typedef struct
+{
+    const char *name;            // strong side first: "KRKP" = White K+R against Black K+P
+    int n;                       // pieces
+    int pieces[BITBASE_PIECES];  // mailbox codes: strong king, weak king, then the others
+    int dims[BITBASE_PIECES];    // index range of each piece's square
+    int has_pawns;
+    uint64_t size;               // positions: side to move x squares
+    uint64_t key, key2;          // material with the strong side as White / as Black
+    const unsigned char *packed; // the table, NULL until built or loaded
+    unsigned char *owned;        // the generator's copy, freed once the file is mapped
+} BitbaseSet;
+
+// In build order: each ending only leaves into endings above it (or dead draws)
+static BitbaseSet sets[] = {{.name = "KQK"},  {.name = "KRK"},  {.name = "KPK"},  {.name = "KBNK"}, {.name = "KQKR"},
+                            {.name = "KRKR"}, {.name = "KRKB"}, {.name = "KRKN"}, {.name = "KRKP"}};
+#define N_SETS ((int)(sizeof(sets) / sizeof(sets[0])))
+
+static const unsigned char *file_data = NULL;
+static size_t file_size = 0;
+
+static const int TRIANGLE[10] = {0, 1, 2, 3, 9, 10, 11, 18, 19, 27}; // a1 b1 c1 d1 b2 c2 d2 c3 d3 d4
+static int triangle_slot[64];
+
+static uint64_t material_key_counts(const int counts[2][5])
+{
+    uint64_t key = 0;
+    for (int c = 0; c < 2; c++)
+        for (int t = 0; t < 5; t++)
+            key |= (uint64_t)counts[c][t] << (4 * (t + 5 * c));
+    return key;
+}
+
+static uint64_t material_key(const Board *b)
+{
+    int counts[2][5];
+    for (int c = 0; c < 2; c++)
+        for (int t = 0; t < 5; t++)
+            counts[c][t] = popcount(board_pieces(b, c, t));
+    return material_key_counts(counts);
+}
+
+static void init_sets(void)
+{
+    static int done = 0;
+    if (done)
+        return;
+    done = 1;
+
+    for (int sq = 0; sq < 64; sq++)
+        triangle_slot[sq] = -1;
+    for (int i = 0; i < 10; i++)
+        triangle_slot[TRIANGLE[i]] = i;
+
+    for (int i = 0; i < N_SETS; i++)
+    {
+        BitbaseSet *s = &sets[i];
+        int counts[2][5] = {{0}};
+        int color = -1, others = 2;
+        s->has_pawns = strchr(s->name, 'P') != NULL;
+        for (const char *p = s->name; *p; p++)
+        {
+            if (*p == 'K')
+            {
+                color++;
+                s->pieces[color] = make_piece(color, KING);
+                continue;
+            }
+            counts[color][piece_index(*p)]++;
+            s->pieces[others++] = make_piece(color, piece_index(*p));
+        }
+        s->n = others;
+        s->size = 2;
+        for (int j = 0; j < s->n; j++)
+        {
+            s->dims[j] = j == 0 ? (s->has_pawns ? 32 : 10) : piece_type(s->pieces[j]) == PAWN ? 48 : 64;
+            s->size *= s->dims[j];
+        }
+        s->key = material_key_counts(counts);
+        int swapped[2][5];
+        for (int t = 0; t < 5; t++)
+        {
+            swapped[0][t] = counts[1][t];
+            swapped[1][t] = counts[0][t];
+        }
+        s->key2 = material_key_counts(swapped);
+    }
+}
+
+// Symmetry t of a square: bit 0 mirrors the files, bit 1 the ranks, bit 2 swaps them
+static int transform(int sq, int t)
+{
+    if (t & 1)
+        sq ^= 7;
+    if (t & 2)
+        sq ^= 56;
+    if (t & 4)
+        sq = ((sq >> 3) | (sq << 3)) & 63;
+    return sq;
+}
+
+static uint64_t index_under(const BitbaseSet *s, const int *squares, int stm, int t)
+{
+    uint64_t idx = (uint64_t)stm;
+    for (int i = 0; i < s->n; i++)
+    {
+        int sq = transform(squares[i], t), slot;
+        if (i == 0)
+            slot = s->has_pawns ? (sq >> 3) * 4 + (sq & 7) : triangle_slot[sq];
+        else if (piece_type(s->pieces[i]) == PAWN)
+            slot = sq - 8;
+        else
+            slot = sq;
+        idx = idx * s->dims[i] + slot;
+    }
+    return idx;
+}
+
+// Index of a position from its squares (a1 = 0, set order) and side to move. A king on
+// the a1-h8 diagonal leaves two symmetries that fold it into the triangle: the smaller
+// index wins, so that every position has one index and the retrograde pass, which only
+// unmakes moves in the decoded form, reaches all predecessors.
+static uint64_t position_index(const BitbaseSet *s, const int *squares, int stm)
+{
+    if (s->has_pawns)
+        return index_under(s, squares, stm, (squares[0] & 7) > 3);
+    uint64_t best = UINT64_MAX;
+    for (int t = 0; t < 8; t++)
+    {
+        if (triangle_slot[transform(squares[0], t)] < 0)
+            continue;
+        uint64_t idx = index_under(s, squares, stm, t);
+        if (idx < best)
+            best = idx;
+    }
+    return best;
+}
+
+static int decode_index(const BitbaseSet *s, uint64_t idx, int *squares)
+{
+    for (int i = s->n - 1; i >= 0; i--)
+    {
+        int slot = (int)(idx % s->dims[i]);
+        idx /= s->dims[i];
+        if (i == 0)
+            squares[i] = s->has_pawns ? (slot / 4) * 8 + slot % 4 : TRIANGLE[slot];
+        else if (piece_type(s->pieces[i]) == PAWN)
+            squares[i] = slot + 8;
+        else
+            squares[i] = slot;
+    }
+    return (int)idx; // side to move
+}
+
+// Index of a board holding this ending; flip = the strong side is Black
+static uint64_t board_index(const BitbaseSet *s, const Board *b, int flip)
+{
+    int squares[BITBASE_PIECES];
+    for (int i = 0; i < s->n; i++)
+    {
+        int p = s->pieces[i];
+        squares[i] = lsb(board_pieces(b, piece_color(p) ^ flip, piece_type(p))) ^ (flip ? 0 : 56);
+    }
+    return position_index(s, squares, b->side ^ flip);
+}
+
+static int packed_value(const BitbaseSet *s, uint64_t idx)
+{
+    return (s->packed[idx >> 2] >> (2 * (idx & 3))) & 3;
+}
+
+static BitbaseSet *find_set(const Board *b, int *flip)
+{
+    uint64_t key = material_key(b);
+    for (int i = 0; i < N_SETS; i++)
+    {
+        if (!sets[i].packed)
+            continue;
+        if (sets[i].key == key)
+        {
+            *flip = 0;
+            return &sets[i];
+        }
+        if (sets[i].key2 == key)
+        {
+            *flip = 1;
+            return &sets[i];
+        }
+    }
+    return NULL;
+}
+
+int bitbase_probe(const Board *b, int *wdl)
+{
+    if (popcount(board_occupied(b)) > BITBASE_PIECES || b->castling)
+        return 0;
+    int flip;
+    BitbaseSet *s = find_set(b, &flip);
+    if (!s)
+        return 0;
+    int v = packed_value(s, board_index(s, b, flip));
+    if (v == PK_ILLEGAL)
+        return 0;
+    *wdl = v == PK_WIN ? BB_WIN : v == PK_LOSS ? BB_LOSS : BB_DRAW;
+    return 1;
+}
+
+int bitbase_loaded(void)
+{
+    return file_data != NULL;
+}
+
+// ---- generation ----
+
+typedef struct
+{
+    BitbaseSet *set;
+    unsigned char *state;
+    const uint32_t *frontier; // positions decided in the previous level
+    uint64_t n_frontier;
+    uint32_t *next[BB_MAX_THREADS]; // decided in this level, per thread
+    uint64_t n_next[BB_MAX_THREADS];
+    uint64_t cap_next[BB_MAX_THREADS];
+    int threads;
+    int failed; // a worker ran out of memory, read with atomics
+} GenJob;
+
+typedef struct
+{
+    GenJob *job;
+    int id;
+} GenWorker;
+
+// Out of memory fails the whole job: the position would be missing from the next level
+static void push_next(GenJob *job, int id, uint64_t idx)
+{
+    if (job->n_next[id] == job->cap_next[id])
+    {
+        uint64_t cap = job->cap_next[id] ? job->cap_next[id] * 2 : 4096;
+        uint32_t *grown = (uint32_t *)realloc(job->next[id], cap * sizeof(uint32_t));
+        if (!grown)
+        {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        job->next[id] = grown;
+        job->cap_next[id] = cap;
+    }
+    job->next[id][job->n_next[id]++] = (uint32_t)idx;
+}
+
+// Decide a position, unless another thread got there first
+static void decide(GenJob *job, int id, uint64_t idx, unsigned char seen, int value)
+{
+    unsigned char desired = (unsigned char)((seen & ~ST_VALUE) | value);
+    if (__atomic_compare_exchange_n(&job->state[idx], &seen, desired, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        push_next(job, id, idx);
+}
+
+// Place the pieces on an empty board; 0 if two share a square
+static int setup_board(const BitbaseSet *s, const int *squares, int stm, Board *b)
+{
+    memset(b, 0, sizeof(*b));
+    b->king_sq[WHITE] = b->king_sq[BLACK] = NO_SQUARE;
+    b->ep_square = NO_SQUARE;
+    b->side = (unsigned char)stm;
+    for (int i = 0; i < s->n; i++)
+    {
+        int sq = squares[i] ^ 56;
+        if (b->squares[sq] != NO_PIECE)
+            return 0;
+        board_put(b, sq, s->pieces[i]);
+    }
+    return 1;
+}
+
+// Captures and promotions leave the ending
+static int leaves_set(const Board *b, const Move *m)
+{
+    return m->promo || b->squares[SQ(m->to_x, m->to_y)] != NO_PIECE;
+}
+
+// Result for the side to move after leaving the ending
+static int exit_value(const Board *b)
+{
+    // Bare kings, or a single minor piece, cannot mate
+    Bitboard minors = b->pieces[KNIGHT] | b->pieces[BISHOP];
+    Bitboard kings = b->pieces[KING];
+    if ((board_occupied(b) & ~kings & ~minors) == 0 && popcount(minors) <= 1)
+        return BB_DRAW;
+    int wdl;
+    if (bitbase_probe(b, &wdl))
+        return wdl;
+    return BB_DRAW; // not reachable with the build order above
+}
+
+static void init_position(GenJob *job, int id, uint64_t idx, Board *b)
+{
+    const BitbaseSet *s = job->set;
+    int squares[BITBASE_PIECES];
+    int stm = decode_index(s, idx, squares);
+    // Also unused: the non-canonical twin of a position with the king on the diagonal
+    if (position_index(s, squares, stm) != idx || !setup_board(s, squares, stm, b) ||
+        is_square_attacked(b, b->king_sq[!stm], stm))
+    {
+        job->state[idx] = ST_ILLEGAL;
+        return;
+    }
+
+    Move moves[256];
+    int n = 0;
+    generate_legal_moves(b, stm, ~0ULL, 0, moves, &n);
+    if (n == 0)
+    {
+        if (is_square_attacked(b, b->king_sq[stm], !stm))
+        {
+            job->state[idx] = ST_LOSS;
+            push_next(job, id, idx);
+        }
+        else
+            job->state[idx] = ST_DRAW;
+        return;
+    }
+
+    unsigned char flags = ST_UNKNOWN;
+    int stays = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (!leaves_set(b, &moves[i]))
+        {
+            stays++;
+            continue;
+        }
+        Snapshot snap;
+        make_move(b, &moves[i], &snap);
+        int wdl = exit_value(b);
+        undo_move(b, &moves[i], &snap);
+        if (wdl == BB_LOSS)
+        {
+            job->state[idx] = ST_WIN;
+            push_next(job, id, idx);
+            return;
+        }
+        if (wdl == BB_DRAW)
+            flags |= ST_CANT_LOSE;
+    }
+    if (!stays && !(flags & ST_CANT_LOSE))
+    {
+        // Every move leaves the ending and loses: nothing in here would ever decide it
+        job->state[idx] = ST_LOSS;
+        push_next(job, id, idx);
+        return;
+    }
+    job->state[idx] = flags;
+}
+
+// Every move that stays in the ending reaches a position won for the opponent
+static int all_moves_lose(GenJob *job, Board *b)
+{
+    Move moves[256];
+    int n = 0;
+    generate_legal_moves(b, b->side, ~0ULL, 0, moves, &n);
+    for (int i = 0; i < n; i++)
+    {
+        if (leaves_set(b, &moves[i]))
+            continue; // all losing, or the position would be decided or flagged already
+        Snapshot snap;
+        make_move(b, &moves[i], &snap);
+        uint64_t child = board_index(job->set, b, 0);
+        undo_move(b, &moves[i], &snap);
+        if ((__atomic_load_n(&job->state[child], __ATOMIC_RELAXED) & ST_VALUE) != ST_WIN)
+            return 0;
+    }
+    return 1;
+}
+
+// Unmake every move that could have led to the decided position idx
+static void propagate_position(GenJob *job, int id, uint64_t idx, Board *b)
+{
+    const BitbaseSet *s = job->set;
+    int squares[BITBASE_PIECES];
+    int stm = decode_index(s, idx, squares);
+    int value = job->state[idx] & ST_VALUE;
+    int mover = !stm;
+    setup_board(s, squares, stm, b);
+    Bitboard occ = board_occupied(b);
+
+    for (int i = 0; i < s->n; i++)
+    {
+        if (piece_color(s->pieces[i]) != mover)
+            continue;
+        int sq = squares[i] ^ 56;
+        int type = piece_type(s->pieces[i]);
+        Bitboard from_set;
+        if (type == PAWN)
+        {
+            // One step back, or two from the fourth rank; never from the first rank
+            int back = mover == WHITE ? 8 : -8;
+            int start_row = mover == WHITE ? 4 : 3;
+            from_set = 0;
+            int one = sq + back;
+            if (SQ_X(one) >= 1 && SQ_X(one) <= 6 && !(occ & BIT(one)))
+            {
+                from_set |= BIT(one);
+                if (SQ_X(sq) == start_row && !(occ & BIT(one + back)))
+                    from_set |= BIT(one + back);
+            }
+        }
+        else if (type == KNIGHT)
+            from_set = knight_attacks[sq] & ~occ;
+        else if (type == BISHOP)
+            from_set = bishop_attacks_from(sq, occ) & ~occ;
+        else if (type == ROOK)
+            from_set = rook_attacks_from(sq, occ) & ~occ;
+        else if (type == QUEEN)
+            from_set = queen_attacks_from(sq, occ) & ~occ;
+        else
+            from_set = king_attacks[sq] & ~occ;
+
+        while (from_set)
+        {
+            int from = pop_lsb(&from_set);
+            board_move(b, sq, from);
+            b->side = (unsigned char)mover;
+            // The side that did not move may not have been left in check
+            if (!is_square_attacked(b, b->king_sq[stm], mover))
+            {
+                uint64_t prev = board_index(s, b, 0);
+                unsigned char seen = __atomic_load_n(&job->state[prev], __ATOMIC_RELAXED);
+                if ((seen & ST_VALUE) == ST_UNKNOWN)
+                {
+                    if (value == ST_LOSS)
+                        decide(job, id, prev, seen, ST_WIN);
+                    else if (!(seen & ST_CANT_LOSE) && all_moves_lose(job, b))
+                        decide(job, id, prev, seen, ST_LOSS);
+                }
+            }
+            board_move(b, from, sq);
+            b->side = (unsigned char)stm;
+        }
+    }
+}
+
+static void *init_worker(void *arg)
+{
+    GenWorker *w = (GenWorker *)arg;
+    GenJob *job = w->job;
+    uint64_t size = job->set->size;
+    Board b;
+    for (uint64_t idx = size * w->id / job->threads; idx < size * (w->id + 1) / job->threads; idx++)
+    {
+        if (__atomic_load_n(&job->failed, __ATOMIC_RELAXED))
+            break;
+        init_position(job, w->id, idx, &b);
+    }
+    return NULL;
+}
+
+static void *propagate_worker(void *arg)
+{
+    GenWorker *w = (GenWorker *)arg;
+    GenJob *job = w->job;
+    uint64_t n = job->n_frontier;
+    Board b;
+    for (uint64_t i = n * w->id / job->threads; i < n * (w->id + 1) / job->threads; i++)
+    {
+        if (__atomic_load_n(&job->failed, __ATOMIC_RELAXED))
+            break;
+        propagate_position(job, w->id, job->frontier[i], &b);
+    }
+    return NULL;
+}
+
+static void run_workers(GenJob *job, void *(*fn)(void *))
+{
+    pthread_t handles[BB_MAX_THREADS];
+    GenWorker workers[BB_MAX_THREADS];
+    int started[BB_MAX_THREADS];
+    for (int i = 1; i < job->threads; i++)
+    {
+        workers[i] = (GenWorker){job, i};
+        started[i] = pthread_create(&handles[i], NULL, fn, &workers[i]) == 0;
+        if (!started[i])
+            fn(&workers[i]);
+    }
+    workers[0] = (GenWorker){job, 0};
+    fn(&workers[0]);
+    for (int i = 1; i < job->threads; i++)
+        if (started[i])
+            pthread_join(handles[i], NULL);
+}
+
+// 0 when out of memory
+static int generate_set(BitbaseSet *s, int threads)
+{
+    GenJob job;
+    memset(&job, 0, sizeof(job));
+    job.set = s;
+    job.threads = threads;
+    job.state = (unsigned char *)calloc(s->size, 1);
+    unsigned char *packed = (unsigned char *)calloc((s->size + 3) / 4, 1);
+    if (!job.state || !packed)
+    {
+        free(job.state);
+        free(packed);
+        return 0;
+    }
+
+    run_workers(&job, init_worker);
+    uint32_t *frontier = NULL;
+    int levels = 0;
+    while (!job.failed)
+    {
+        uint64_t total = 0;
+        for (int i = 0; i < threads; i++)
+            total += job.n_next[i];
+        if (total == 0)
+            break;
+        free(frontier);
+        frontier = (uint32_t *)malloc(total * sizeof(uint32_t));
+        if (!frontier)
+        {
+            job.failed = 1;
+            break;
+        }
+        uint64_t at = 0;
+        for (int i = 0; i < threads; i++)
+        {
+            memcpy(frontier + at, job.next[i], job.n_next[i] * sizeof(uint32_t));
+            at += job.n_next[i];
+            job.n_next[i] = 0;
+        }
+        job.frontier = frontier;
+        job.n_frontier = total;
+        run_workers(&job, propagate_worker);
+        levels++;
+    }
+    free(frontier);
+    for (int i = 0; i < threads; i++)
+        free(job.next[i]);
+    if (job.failed)
+    {
+        fprintf(stderr, "bitbase: out of memory building %s\n", s->name);
+        free(job.state);
+        free(packed);
+        return 0;
+    }
+
+    uint64_t wins = 0, losses = 0, draws = 0;
+    for (uint64_t idx = 0; idx < s->size; idx++)
+    {
+        int v = job.state[idx] & ST_VALUE;
+        int pk = v == ST_WIN ? PK_WIN : v == ST_LOSS ? PK_LOSS : v == ST_ILLEGAL ? PK_ILLEGAL : PK_DRAW;
+        wins += pk == PK_WIN;
+        losses += pk == PK_LOSS;
+        draws += pk == PK_DRAW;
+        packed[idx >> 2] |= (unsigned char)(pk << (2 * (idx & 3)));
+    }
+    free(job.state);
+    s->owned = packed;
+    s->packed = packed;
+    fprintf(stderr, "bitbase %-5s %10llu positions: %llu wins, %llu draws, %llu losses (%d levels)\n", s->name,
+                    (unsigned long long)s->size, (unsigned long long)wins, (unsigned long long)draws,
+                    (unsigned long long)losses, levels);
+    return 1;
+}
+
+static void put_le(unsigned char *p, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t get_le(const unsigned char *p, int bytes)
+{
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+        v = v << 8 | p[i];
+    return v;
+}
+
+static size_t header_size(void)
+{
+    return 8 + 24 * (size_t)N_SETS;
+}
+
+int bitbase_generate(const char *path, int threads)
+{
+    Board scratch;
+    board_init(&scratch); // Zobrist, piece-square and attack tables
+    init_sets();
+    bitbase_close();
+    if (threads < 1)
+        threads = 1;
+    if (threads > BB_MAX_THREADS)
+        threads = BB_MAX_THREADS;
+
+    // Open first: no point in building what cannot be written
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        fprintf(stderr, "bitbase: cannot write %s\n", path);
+        return 0;
+    }
+    long long start = now_ms();
+    int ok = 1;
+    for (int i = 0; i < N_SETS && ok; i++)
+        ok = generate_set(&sets[i], threads);
+
+    if (ok)
+    {
+        unsigned char header[8 + 24 * N_SETS];
+        size_t hsize = header_size();
+        memset(header, 0, sizeof(header));
+        memcpy(header, BB_MAGIC, 4);
+        put_le(header + 4, N_SETS, 4);
+        uint64_t offset = hsize;
+        for (int i = 0; i < N_SETS; i++)
+        {
+            unsigned char *e = header + 8 + 24 * i;
+            strncpy((char *)e, sets[i].name, 8);
+            put_le(e + 8, offset, 8);
+            put_le(e + 16, sets[i].size, 8);
+            offset += (sets[i].size + 3) / 4;
+        }
+        ok = fwrite(header, 1, hsize, f) == hsize;
+        for (int i = 0; i < N_SETS && ok; i++)
+        {
+            size_t bytes = (sets[i].size + 3) / 4;
+            ok = fwrite(sets[i].owned, 1, bytes, f) == bytes;
+        }
+    }
+    ok = fclose(f) == 0 && ok;
+
+    for (int i = 0; i < N_SETS; i++)
+    {
+        free(sets[i].owned);
+        sets[i].owned = NULL;
+        sets[i].packed = NULL;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "bitbase: cannot write %s\n", path);
+        remove(path); // no truncated file left behind
+        return 0;
+    }
+    fprintf(stderr, "bitbases written to %s in %lld ms\n", path, now_ms() - start);
+    return bitbase_open(path);
+}
+
+int bitbase_open(const char *path)
+{
+    init_sets();
+    bitbase_close();
+#ifdef _WIN32
+    // No mmap: read the whole file instead
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return 0;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *data = size > 0 ? (unsigned char *)malloc((size_t)size) : NULL;
+    if (!data || fread(data, 1, (size_t)size, f) != (size_t)size)
+    {
+        free(data);
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < header_size())
+    {
+        close(fd);
+        return 0;
+    }
+    off_t size = st.st_size;
+    void *data = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid
+    if (data == MAP_FAILED)
+        return 0;
+#endif
+    file_data = (const unsigned char *)data;
+    file_size = (size_t)size;
+
+    // The file must hold exactly the endings of this build
+    int ok = file_size >= header_size() && memcmp(file_data, BB_MAGIC, 4) == 0 && get_le(file_data + 4, 4) == (uint64_t)N_SETS;
+    for (int i = 0; i < N_SETS && ok; i++)
+    {
+        const unsigned char *e = file_data + 8 + 24 * i;
+        uint64_t offset = get_le(e + 8, 8), positions = get_le(e + 16, 8);
+        ok = strncmp((const char *)e, sets[i].name, 8) == 0 && positions == sets[i].size &&
+             offset + (positions + 3) / 4 <= file_size;
+        if (ok)
+            sets[i].packed = file_data + offset;
+    }
+    if (!ok)
+    {
+        bitbase_close();
+        return 0;
+    }
+    return 1;
+}
+
+int bitbase_init(const char *path, int threads)
+{
+    return bitbase_open(path) || bitbase_generate(path, threads);
+}
+
+void bitbase_close(void)
+{
+    for (int i = 0; i < N_SETS; i++)
+        if (!sets[i].owned)
+            sets[i].packed = NULL;
+    if (!file_data)
+        return;
+#ifdef _WIN32
+    free((void *)file_data);
+#else
+    munmap((void *)file_data, file_size);
+#endif
+    file_data = NULL;
+    file_size = 0;
+}
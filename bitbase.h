@@ -0,0 +1,26 @@
+#ifndef BITBASE_H
+#define BITBASE_H
+#include "board.h"
+
+// Win/draw/loss bitbases for a few small endings (KQK, KRK, KPK, KBNK, KQKR, KRKR, KRKB,
+// KRKN, KRKP), computed by retrograde analysis over our own move generator and kept two
+// bits per position in one file that is memory-mapped by later runs.
+
+#define BITBASE_PIECES 4 // most pieces, kings included, of any covered ending
+#define BITBASE_THREADS 4 // generator threads unless given
+
+enum
+{
+    BB_LOSS = -1,
+    BB_DRAW = 0,
+    BB_WIN = 1
+};
+
+int bitbase_generate(const char *path, int threads); // build every ending and write the file; 1 on success
+int bitbase_open(const char *path);                  // 1 on success; replaces any open file
+int bitbase_init(const char *path, int threads);     // open, generating the file first if it is missing or stale
+void bitbase_close(void);
+int bitbase_loaded(void);
+int bitbase_probe(const Board *b, int *wdl); // 1 if the ending is covered: *wdl for the side to move
+
+#endif
\ No newline at end of file
@@ -2,24 +2,152 @@
 #include "move_gen.h"
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
 
-void board_init(Board *b)
+uint64_t zobrist_piece[16][64];
+uint64_t zobrist_castling[16];
+uint64_t zobrist_ep[8];
+uint64_t zobrist_side;
+
+// splitmix64: fixed seed so keys are identical across runs
+static uint64_t zobrist_next(uint64_t *state)
 {
-    memset(b, 0, sizeof(*b));
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void zobrist_init(void)
+{
+    static int done = 0;
+    if (done)
+        return;
+    uint64_t state = 0x1234ABCD5678EF01ULL;
+    for (int p = 0; p < 16; p++)
+        for (int sq = 0; sq < 64; sq++)
+            zobrist_piece[p][sq] = zobrist_next(&state);
+    // Each rights mask hashes as the XOR of its individual rights
+    uint64_t rights[4];
+    for (int i = 0; i < 4; i++)
+        rights[i] = zobrist_next(&state);
+    for (int mask = 0; mask < 16; mask++)
+    {
+        zobrist_castling[mask] = 0;
+        for (int i = 0; i < 4; i++)
+            if (mask & (1 << i))
+                zobrist_castling[mask] ^= rights[i];
+    }
+    zobrist_side = zobrist_next(&state);
     for (int i = 0; i < 8; i++)
+        zobrist_ep[i] = zobrist_next(&state);
+    done = 1;
+}
+
+int psq_mg[16][64];
+int psq_eg[16][64];
+
+static const int piece_value[6] = {100, 320, 330, 500, 900, 20000};
+
+// Piece-square tables from White's side, a8 first (the board's own square order).
+// Only the king changes its mind between middlegame and endgame.
+static const int pst[6][64] = {
+    {0, 0, 0, 0, 0, 0, 0, 0,
+     50, 50, 50, 50, 50, 50, 50, 50,
+     10, 10, 20, 30, 30, 20, 10, 10,
+     5, 5, 10, 25, 25, 10, 5, 5,
+     0, 0, 0, 20, 20, 0, 0, 0,
+     5, -5, -10, 0, 0, -10, -5, 5,
+     5, 10, 10, -20, -20, 10, 10, 5,
+     0, 0, 0, 0, 0, 0, 0, 0},
+    {-50, -40, -30, -30, -30, -30, -40, -50,
+     -40, -20, 0, 0, 0, 0, -20, -40,
+     -30, 0, 10, 15, 15, 10, 0, -30,
+     -30, 5, 15, 20, 20, 15, 5, -30,
+     -30, 0, 15, 20, 20, 15, 0, -30,
+     -30, 5, 10, 15, 15, 10, 5, -30,
+     -40, -20, 0, 5, 5, 0, -20, -40,
+     -50, -40, -30, -30, -30, -30, -40, -50},
+    {-20, -10, -10, -10, -10, -10, -10, -20,
+     -10, 0, 0, 0, 0, 0, 0, -10,
+     -10, 0, 5, 10, 10, 5, 0, -10,
+     -10, 5, 5, 10, 10, 5, 5, -10,
+     -10, 0, 10, 10, 10, 10, 0, -10,
+     -10, 10, 10, 10, 10, 10, 10, -10,
+     -10, 5, 0, 0, 0, 0, 5, -10,
+     -20, -10, -10, -10, -10, -10, -10, -20},
+    {0, 0, 0, 0, 0, 0, 0, 0,
+     5, 10, 10, 10, 10, 10, 10, 5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     0, 0, 0, 5, 5, 0, 0, 0},
+    {-20, -10, -10, -5, -5, -10, -10, -20,
+     -10, 0, 0, 0, 0, 0, 0, -10,
+     -10, 0, 5, 5, 5, 5, 0, -10,
+     -5, 0, 5, 5, 5, 5, 0, -5,
+     0, 0, 5, 5, 5, 5, 0, -5,
+     -10, 5, 5, 5, 5, 5, 0, -10,
+     -10, 0, 5, 0, 0, 0, 0, -10,
+     -20, -10, -10, -5, -5, -10, -10, -20},
+    {-30, -40, -40, -50, -50, -40, -40, -30,
+     -30, -40, -40, -50, -50, -40, -40, -30,
+     -30, -40, -40, -50, -50, -40, -40, -30,
+     -30, -40, -40, -50, -50, -40, -40, -30,
+     -20, -30, -30, -40, -40, -30, -30, -20,
+     -10, -20, -20, -20, -20, -20, -20, -10,
+     20, 20, 0, 0, 0, 0, 20, 20,
+     20, 30, 10, 0, 0, 10, 30, 20},
+};
+
+static const int king_pst_eg[64] = {
+    -50, -40, -30, -20, -20, -30, -40, -50,
+    -30, -20, -10, 0, 0, -10, -20, -30,
+    -30, -10, 20, 30, 30, 20, -10, -30,
+    -30, -10, 30, 40, 40, 30, -10, -30,
+    -30, -10, 30, 40, 40, 30, -10, -30,
+    -30, -10, 20, 30, 30, 20, -10, -30,
+    -30, -30, 0, 0, 0, 0, -30, -30,
+    -50, -30, -30, -30, -30, -30, -30, -50};
+
+// Fold value and table into one signed entry per (piece, square); Black reads the
+// table mirrored vertically (sq ^ 56)
+static void psq_init(void)
+{
+    static int done = 0;
+    if (done)
+        return;
+    for (int t = PAWN; t <= KING; t++)
     {
-        for (int j = 0; j < 8; j++)
+        for (int sq = 0; sq < 64; sq++)
         {
-            b->cells[i][j].state = 'E';
-            b->cells[i][j].piece = 0;
+            int mg = piece_value[t] + pst[t][sq];
+            int eg = piece_value[t] + (t == KING ? king_pst_eg[sq] : pst[t][sq]);
+            psq_mg[make_piece(WHITE, t)][sq] = mg;
+            psq_eg[make_piece(WHITE, t)][sq] = eg;
+            mg = piece_value[t] + pst[t][sq ^ 56];
+            eg = piece_value[t] + (t == KING ? king_pst_eg[sq ^ 56] : pst[t][sq ^ 56]);
+            psq_mg[make_piece(BLACK, t)][sq] = -mg;
+            psq_eg[make_piece(BLACK, t)][sq] = -eg;
         }
     }
-    b->castling_W_K = 1;
-    b->castling_W_Q = 1;
-    b->castling_B_K = 1;
-    b->castling_B_Q = 1;
-    b->history_size = 0;
-    b->has_last_move = 0;
+    done = 1;
+}
+
+void board_init(Board *b)
+{
+    zobrist_init();
+    psq_init();
+    attacks_init();
+    memset(b, 0, sizeof(*b));
+    b->castling = CASTLE_WK | CASTLE_WQ | CASTLE_BK | CASTLE_BQ;
+    b->key = zobrist_castling[b->castling];
+    b->side = WHITE;
+    b->ep_square = NO_SQUARE;
+    b->king_sq[WHITE] = b->king_sq[BLACK] = NO_SQUARE;
+    b->game = NULL;
 
     // Place pieces (same as Python create_empty_board)
     const char order[8] = {'R', 'N', 'B', 'Q', 'K', 'B', 'N', 'R'};
@@ -34,55 +162,136 @@ void board_init(Board *b)
     }
 }
 
-void board_set_piece(Board *b, int x, int y, char piece, char color)
+// Load a position from a FEN string. Returns 0 on malformed input.
+// No game record is attached afterwards (see board_attach_game).
+int board_set_fen(Board *b, const char *fen)
 {
-    b->cells[x][y].piece = piece;
-    b->cells[x][y].state = color;
-}
+    zobrist_init();
+    psq_init();
+    attacks_init();
+    memset(b, 0, sizeof(*b));
+    b->ep_square = NO_SQUARE;
+    b->king_sq[WHITE] = b->king_sq[BLACK] = NO_SQUARE;
 
-int board_find_king(Board *b, char color, int *outx, int *outy)
-{
-    for (int i = 0; i < 8; i++)
+    const char *p = fen;
+    while (*p == ' ')
+        p++;
+
+    // Piece placement, from rank 8 down
+    int x = 0, y = 0;
+    for (; *p && *p != ' '; p++)
     {
-        for (int j = 0; j < 8; j++)
+        if (*p == '/')
         {
-            Cell c = b->cells[i][j];
-            if (c.piece == 'K' && c.state == color)
-            {
-                *outx = i;
-                *outy = j;
-                return 1;
-            }
+            x++;
+            y = 0;
+        }
+        else if (*p >= '1' && *p <= '8')
+        {
+            y += *p - '0';
+        }
+        else
+        {
+            int type = piece_index((char)toupper((unsigned char)*p));
+            if (type < 0 || x > 7 || y > 7)
+                return 0;
+            board_put(b, SQ(x, y), make_piece(islower((unsigned char)*p) ? BLACK : WHITE, type));
+            y++;
         }
     }
-    return 0;
+    if (popcount(board_pieces(b, WHITE, KING)) != 1 || popcount(board_pieces(b, BLACK, KING)) != 1)
+        return 0;
+
+    // Side to move
+    while (*p == ' ')
+        p++;
+    b->side = (*p == 'b') ? BLACK : WHITE;
+    if (*p)
+        p++;
+
+    // Castling rights
+    while (*p == ' ')
+        p++;
+    for (; *p && *p != ' '; p++)
+    {
+        if (*p == 'K')
+            b->castling |= CASTLE_WK;
+        else if (*p == 'Q')
+            b->castling |= CASTLE_WQ;
+        else if (*p == 'k')
+            b->castling |= CASTLE_BK;
+        else if (*p == 'q')
+            b->castling |= CASTLE_BQ;
+    }
+
+    // En passant square, kept only when a pawn can actually capture there
+    while (*p == ' ')
+        p++;
+    if (p[0] >= 'a' && p[0] <= 'h' && (p[1] == '3' || p[1] == '6'))
+    {
+        int ep = SQ(8 - (p[1] - '0'), p[0] - 'a');
+        if (pawn_attacks[!b->side][ep] & board_pieces(b, b->side, PAWN))
+            b->ep_square = ep;
+        p += 2;
+    }
+    for (; *p && *p != ' '; p++)
+        ;
+
+    // Halfmove clock (the fullmove number is not tracked)
+    b->rule50 = (int)strtol(p, NULL, 10);
+
+    b->key = position_key(b);
+    return 1;
+}
+
+void board_set_piece(Board *b, int x, int y, char piece, char color)
+{
+    int sq = SQ(x, y);
+    if (b->squares[sq] != NO_PIECE)
+        board_remove(b, sq);
+    if (piece && color != 'E')
+        board_put(b, sq, make_piece(color_index(color), piece_index(piece)));
+}
+
+// Compatibility view of one square for the drawing and CLI code
+Cell board_cell(const Board *b, int x, int y)
+{
+    int p = b->squares[SQ(x, y)];
+    if (p == NO_PIECE)
+        return (Cell){'E', 0};
+    return (Cell){color_char(piece_color(p)), PIECE_CHARS[piece_type(p)]};
+}
+
+int board_find_king(Board *b, char color, int *outx, int *outy)
+{
+    int sq = b->king_sq[color_index(color)];
+    if (sq == NO_SQUARE)
+        return 0;
+    *outx = SQ_X(sq);
+    *outy = SQ_Y(sq);
+    return 1;
 }
 
 int board_is_in_check(Board *b, char color)
 {
-    int kx, ky;
-    if (!board_find_king(b, color, &kx, &ky))
+    int c = color_index(color);
+    int king = b->king_sq[c];
+    if (king == NO_SQUARE)
         return 0;
-    char enemy = opposite_color(color);
-    Pos att[64];
-    int att_n = 0;
-    for (int i = 0; i < 8; i++)
+    return is_square_attacked(b, king, !c);
+}
+
+// Does `color` have at least one legal move?
+static int has_legal_move(Board *b, char color)
+{
+    int c = color_index(color);
+    LegalMask m;
+    compute_legal_mask(b, c, &m);
+    Bitboard own = b->colors[c];
+    while (own)
     {
-        for (int j = 0; j < 8; j++)
-        {
-            if (b->cells[i][j].state == enemy)
-            {
-                // include_castling = 0 for checks
-                Pos tmp[64];
-                int tn = 0;
-                get_available_moves(b, i, j, 0, tmp, &tn);
-                for (int t = 0; t < tn; t++)
-                {
-                    if (tmp[t].x == kx && tmp[t].y == ky)
-                        return 1;
-                }
-            }
-        }
+        if (legal_targets(b, pop_lsb(&own), &m, 1))
+            return 1;
     }
     return 0;
 }
@@ -91,332 +300,394 @@ int board_is_checkmate(Board *b, char color)
 {
     if (!board_is_in_check(b, color))
         return 0;
-    for (int i = 0; i < 8; i++)
-    {
-        for (int j = 0; j < 8; j++)
-        {
-            if (b->cells[i][j].state != color)
-                continue;
-            Pos ps[64];
-            int pn = 0, ln = 0;
-            get_available_moves(b, i, j, 1, ps, &pn);
-            Pos leg[64];
-            filter_legal_moves(b, i, j, ps, pn, color, leg, &ln);
-            if (ln > 0)
-                return 0;
-        }
-    }
-    return 1;
+    return !has_legal_move(b, color);
 }
 
 int board_is_stalemate(Board *b, char color)
 {
     if (board_is_in_check(b, color))
         return 0;
-    for (int i = 0; i < 8; i++)
-    {
-        for (int j = 0; j < 8; j++)
-        {
-            if (b->cells[i][j].state != color)
-                continue;
-            Pos ps[64];
-            int pn = 0, ln = 0;
-            get_available_moves(b, i, j, 1, ps, &pn);
-            Pos leg[64];
-            filter_legal_moves(b, i, j, ps, pn, color, leg, &ln);
-            if (ln > 0)
-                return 0;
-        }
-    }
-    return 1;
+    return !has_legal_move(b, color);
 }
 
 int board_can_castle(Board *b, char color, char side)
 {
-    int row = (color == 'W') ? 7 : 0;
-    int king_y = 4;
-    int rook_y = (side == 'K') ? 7 : 0;
+    int c = color_index(color);
+    int row = (c == WHITE) ? 7 : 0;
+    int king_sq = SQ(row, 4);
+    int rook_sq = SQ(row, (side == 'K') ? 7 : 0);
 
     // Check rights
-    if (color == 'W')
+    int right = (c == WHITE) ? (side == 'K' ? CASTLE_WK : CASTLE_WQ)
+                             : (side == 'K' ? CASTLE_BK : CASTLE_BQ);
+    if (!(b->castling & right))
+        return 0;
+
+    // Rook present
+    if (b->squares[rook_sq] != make_piece(c, ROOK))
+        return 0;
+
+    // Empty between & king, pass-through and target squares not attacked
+    int step = (side == 'K') ? 1 : -1;
+    Bitboard between = (side == 'K') ? BIT(SQ(row, 5)) | BIT(SQ(row, 6))
+                                     : BIT(SQ(row, 1)) | BIT(SQ(row, 2)) | BIT(SQ(row, 3));
+    if (board_occupied(b) & between)
+        return 0;
+    for (int k = 0; k <= 2; k++)
     {
-        if (side == 'K' && !b->castling_W_K)
-            return 0;
-        if (side == 'Q' && !b->castling_W_Q)
+        if (is_square_attacked(b, king_sq + k * step, !c))
             return 0;
     }
-    else
+    return 1;
+}
+
+// Rights that survive a move touching `sq` (as origin, or as capture square)
+static inline int castling_kept(int sq)
+{
+    switch (sq)
     {
-        if (side == 'K' && !b->castling_B_K)
-            return 0;
-        if (side == 'Q' && !b->castling_B_Q)
-            return 0;
+    case SQ(7, 4):
+        return ~(CASTLE_WK | CASTLE_WQ);
+    case SQ(7, 7):
+        return ~CASTLE_WK;
+    case SQ(7, 0):
+        return ~CASTLE_WQ;
+    case SQ(0, 4):
+        return ~(CASTLE_BK | CASTLE_BQ);
+    case SQ(0, 7):
+        return ~CASTLE_BK;
+    case SQ(0, 0):
+        return ~CASTLE_BQ;
     }
+    return ~0;
+}
 
-    // Rook present
-    Cell rook = b->cells[row][rook_y];
-    if (!(rook.piece == 'R' && rook.state == color))
-        return 0;
-
-    // Empty between & pass-through not in check
-    int empty_ok = 1;
-    if (side == 'K')
+// Drop castling rights whose king or rook home square a move touches (moved or captured)
+void board_update_castling(Board *b, int from, int to)
+{
+    int rights = b->castling & castling_kept(from) & castling_kept(to);
+    if (rights != b->castling)
     {
-        int squares[2][2] = {{row, 5}, {row, 6}};
-        for (int k = 0; k < 2; k++)
-        {
-            if (b->cells[squares[k][0]][squares[k][1]].state != 'E')
-            {
-                empty_ok = 0;
-                break;
-            }
-        }
-        if (!empty_ok)
-            return 0;
-        if (board_is_in_check(b, color))
-            return 0;
-        // simulate king pass squares
-        for (int k = 0; k < 2; k++)
-        {
-            Cell saved_from = b->cells[row][4];
-            Cell saved_to = b->cells[squares[k][0]][squares[k][1]];
-            b->cells[squares[k][0]][squares[k][1]] = (Cell){color, 'K'};
-            b->cells[row][4] = (Cell){'E', 0};
-            int under = board_is_in_check(b, color);
-            b->cells[row][4] = saved_from;
-            b->cells[squares[k][0]][squares[k][1]] = saved_to;
-            if (under)
-                return 0;
-        }
+        b->key ^= zobrist_castling[b->castling] ^ zobrist_castling[rights];
+        b->castling = (unsigned char)rights;
     }
-    else
-    { // Queenside
-        int sqs[3][2] = {{row, 3}, {row, 2}, {row, 1}};
-        for (int k = 0; k < 3; k++)
-        {
-            if (b->cells[sqs[k][0]][sqs[k][1]].state != 'E')
-            {
-                empty_ok = 0;
-                break;
-            }
-        }
-        if (!empty_ok)
-            return 0;
-        if (board_is_in_check(b, color))
-            return 0;
-        int path[2][2] = {{row, 3}, {row, 2}};
-        for (int k = 0; k < 2; k++)
-        {
-            Cell saved_from = b->cells[row][4];
-            Cell saved_to = b->cells[path[k][0]][path[k][1]];
-            b->cells[path[k][0]][path[k][1]] = (Cell){color, 'K'};
-            b->cells[row][4] = (Cell){'E', 0};
-            int under = board_is_in_check(b, color);
-            b->cells[row][4] = saved_from;
-            b->cells[path[k][0]][path[k][1]] = saved_to;
-            if (under)
-                return 0;
-        }
+}
+
+// Append the position reached by `m` to the game record, growing it as needed
+static void game_push(GameRecord *g, uint64_t key, const Move *m)
+{
+    if (g->size >= g->capacity)
+    {
+        int cap = g->capacity ? g->capacity * 2 : 256;
+        uint64_t *keys = (uint64_t *)realloc(g->keys, sizeof(uint64_t) * cap);
+        if (!keys)
+            return;
+        g->keys = keys;
+        Move *moves = (Move *)realloc(g->moves, sizeof(Move) * cap);
+        if (!moves)
+            return;
+        g->moves = moves;
+        g->capacity = cap;
     }
-    return 1;
+    if (g->size > 0 && m)
+        g->moves[g->size - 1] = *m;
+    g->keys[g->size++] = key;
 }
 
-void board_apply_move(Board *b, int from_x, int from_y, int to_x, int to_y)
+void make_move(Board *b, const Move *m, Snapshot *s)
 {
-    Cell moving = b->cells[from_x][from_y];
-    char piece = moving.piece;
-    char color = moving.state;
+    int from = SQ(m->from_x, m->from_y), to = SQ(m->to_x, m->to_y);
+    s->from = b->squares[from];
+    s->to = b->squares[to];
+
+    // Save castling rights and hash state
+    s->castling = b->castling;
+    s->ep_square = b->ep_square;
+    s->key = b->key;
+    s->rule50 = b->rule50;
+    s->game_size = b->game ? b->game->size : 0;
+
+    s->did_castle = 0;
+    s->did_promo = 0;
+    s->did_ep = 0;
 
-    // Castling move if king moves 2 columns
-    if (piece == 'K' && abs(to_y - from_y) == 2)
+    int piece = piece_type(s->from);
+    int color = piece_color(s->from);
+
+    // Any en passant chance expires with this move
+    int ep = b->ep_square;
+    if (ep != NO_SQUARE)
     {
-        // move rook
-        int row = from_x;
-        if (to_y > from_y)
-        {
-            // kingside
-            b->cells[row][5] = b->cells[row][7];
-            b->cells[row][7] = (Cell){'E', 0};
-        }
-        else
-        {
-            // queenside
-            b->cells[row][3] = b->cells[row][0];
-            b->cells[row][0] = (Cell){'E', 0};
-        }
-        // move king
-        b->cells[to_x][to_y] = moving;
-        b->cells[from_x][from_y] = (Cell){'E', 0};
+        b->key ^= zobrist_ep[SQ_Y(ep)];
+        b->ep_square = NO_SQUARE;
+    }
 
-        // revoke rights
-        if (color == 'W')
-        {
-            b->castling_W_K = 0;
-            b->castling_W_Q = 0;
+    // Move the piece
+    b->rule50++;
+    if (s->to != NO_PIECE)
+    {
+        board_remove(b, to);
+        b->rule50 = 0;
+    }
+    board_move(b, from, to);
+
+    // Handle castling (king moved 2 files)
+    if (piece == KING && abs(m->to_y - m->from_y) == 2)
+    {
+        int row = m->from_x;
+        if (m->to_y > m->from_y)
+        { // kingside
+            // rook h -> f
+            board_move(b, SQ(row, 7), SQ(row, 5));
+            s->did_castle = 1;
+            s->rook_fx = row;
+            s->rook_fy = 7;
+            s->rook_tx = row;
+            s->rook_ty = 5;
         }
         else
-        {
-            b->castling_B_K = 0;
-            b->castling_B_Q = 0;
+        { // queenside
+            // rook a -> d
+            board_move(b, SQ(row, 0), SQ(row, 3));
+            s->did_castle = -1;
+            s->rook_fx = row;
+            s->rook_fy = 0;
+            s->rook_tx = row;
+            s->rook_ty = 3;
         }
     }
-    else
-    {
-        // Regular move
-        b->cells[to_x][to_y] = moving;
-        b->cells[from_x][from_y] = (Cell){'E', 0};
 
-        // Update castling rights if king or rook moved
-        if (piece == 'K')
+    // Revoke rights if king/rook moved or a rook was captured
+    board_update_castling(b, from, to);
+
+    if (piece == PAWN)
+    {
+        b->rule50 = 0;
+        if (to == ep)
         {
-            if (color == 'W')
-            {
-                b->castling_W_K = 0;
-                b->castling_W_Q = 0;
-            }
-            else
-            {
-                b->castling_B_K = 0;
-                b->castling_B_Q = 0;
-            }
+            // the captured pawn sits behind the target square
+            board_remove(b, to + (color == WHITE ? 8 : -8));
+            s->did_ep = 1;
         }
-        else if (piece == 'R')
+        else if (abs(to - from) == 16)
         {
-            if (color == 'W')
-            {
-                if (from_x == 7 && from_y == 0)
-                    b->castling_W_Q = 0;
-                else if (from_x == 7 && from_y == 7)
-                    b->castling_W_K = 0;
-            }
-            else
+            int target = (from + to) / 2;
+            if (pawn_attacks[color][target] & board_pieces(b, !color, PAWN))
             {
-                if (from_x == 0 && from_y == 0)
-                    b->castling_B_Q = 0;
-                else if (from_x == 0 && from_y == 7)
-                    b->castling_B_K = 0;
+                b->ep_square = target;
+                b->key ^= zobrist_ep[SQ_Y(target)];
             }
         }
-    }
-
-    if (piece == 'P')
-    {
-        if ((color == 'W' && to_x == 0) || (color == 'B' && to_x == 7))
+        else if (m->to_x == 0 || m->to_x == 7)
         {
-            b->cells[to_x][to_y].piece = 'Q';
+            s->did_promo = 1;
+            s->promo_prev_piece = 'P';
+            board_remove(b, to);
+            board_put(b, to, make_piece(color, m->promo ? piece_index(m->promo) : QUEEN));
         }
     }
 
-    // Track last move to prevent immediate undo
-    b->last_from_x = from_x;
-    b->last_from_y = from_y;
-    b->last_to_x = to_x;
-    b->last_to_y = to_y;
-    b->has_last_move = 1;
+    b->side ^= 1;
+    b->key ^= zobrist_side;
+    if (b->game)
+        game_push(b->game, b->key, m);
+}
+
+void undo_move(Board *b, const Move *m, Snapshot *s)
+{
+    int from = SQ(m->from_x, m->from_y), to = SQ(m->to_x, m->to_y);
+
+    // Undo castling rook move if any
+    if (s->did_castle != 0)
+        board_move(b, SQ(s->rook_tx, s->rook_ty), SQ(s->rook_fx, s->rook_fy));
+
+    // Restore the piece move (this also undoes a promotion)
+    board_remove(b, to);
+    board_put(b, from, s->from);
+    if (s->to != NO_PIECE)
+        board_put(b, to, s->to);
+    if (s->did_ep)
+    {
+        int color = piece_color(s->from);
+        board_put(b, to + (color == WHITE ? 8 : -8), make_piece(!color, PAWN));
+    }
 
-    // Update repetition table with next side to move
-    char next = opposite_color(color);
-    char key[512];
-    position_key(b, next, key, sizeof(key));
-    history_increment(b, key);
+    // Restore castling rights and hash state
+    b->castling = (unsigned char)s->castling;
+    b->side ^= 1;
+    b->ep_square = s->ep_square;
+    b->key = s->key;
+    b->rule50 = s->rule50;
+    if (b->game)
+        b->game->size = s->game_size;
 }
 
-void get_attack_squares(Board *b, int x, int y, Pos *out, int *out_count)
+// Pass the turn (null-move pruning). The game record gets an empty move so repetition
+// parity holds; rule50 restarts so no repetition is counted across the pass.
+void make_null_move(Board *b, Snapshot *s)
 {
-    *out_count = 0;
-    Cell c = b->cells[x][y];
-    char color = c.state;
-    char piece = c.piece;
-    if (piece == 0 || color == 'E')
-        return;
+    s->ep_square = b->ep_square;
+    s->key = b->key;
+    s->rule50 = b->rule50;
+    s->game_size = b->game ? b->game->size : 0;
 
-    if (piece == 'P')
+    if (b->ep_square != NO_SQUARE)
+        b->key ^= zobrist_ep[SQ_Y(b->ep_square)];
+    b->ep_square = NO_SQUARE;
+    b->rule50 = 0;
+    b->side ^= 1;
+    b->key ^= zobrist_side;
+    if (b->game)
     {
-        int dir = (color == 'W') ? -1 : 1;
-        int nx = x + dir, ny = y - 1;
-        if (nx >= 0 && nx < 8 && ny >= 0 && ny < 8)
-            append_pos(out, out_count, nx, ny);
-        ny = y + 1;
-        if (nx >= 0 && nx < 8 && ny >= 0 && ny < 8)
-            append_pos(out, out_count, nx, ny);
-        return;
+        Move none = {0};
+        game_push(b->game, b->key, &none);
     }
-    if (piece == 'N')
+}
+
+void undo_null_move(Board *b, Snapshot *s)
+{
+    b->side ^= 1;
+    b->ep_square = s->ep_square;
+    b->key = s->key;
+    b->rule50 = s->rule50;
+    if (b->game)
+        b->game->size = s->game_size;
+}
+
+// Play a move for real (CLI / engine); the game record keeps it
+void board_play_move(Board *b, const Move *m)
+{
+    Snapshot s;
+    make_move(b, m, &s);
+}
+
+// Coordinate form used by the CLI; promotions auto-queen
+void board_apply_move(Board *b, int from_x, int from_y, int to_x, int to_y)
+{
+    Move m = {.from_x = from_x, .from_y = from_y, .to_x = to_x, .to_y = to_y};
+    board_play_move(b, &m);
+}
+
+// Full recomputation of the Zobrist key (the board keeps it incrementally)
+uint64_t position_key(Board *b)
+{
+    uint64_t key = 0;
+    Bitboard occ = board_occupied(b);
+    while (occ)
     {
-        int jumps[8][2] = {{2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}};
-        for (int k = 0; k < 8; k++)
-        {
-            int nx = x + jumps[k][0], ny = y + jumps[k][1];
-            if (nx >= 0 && nx < 8 && ny >= 0 && ny < 8)
-                append_pos(out, out_count, nx, ny);
-        }
-        return;
+        int sq = pop_lsb(&occ);
+        key ^= zobrist_piece[b->squares[sq]][sq];
     }
-    if (piece == 'B' || piece == 'Q')
+    key ^= zobrist_castling[b->castling];
+    if (b->ep_square != NO_SQUARE)
+        key ^= zobrist_ep[SQ_Y(b->ep_square)];
+    if (b->side == BLACK)
+        key ^= zobrist_side;
+    return key;
+}
+
+void game_init(GameRecord *g)
+{
+    memset(g, 0, sizeof(*g));
+}
+
+void game_free(GameRecord *g)
+{
+    free(g->keys);
+    free(g->moves);
+    game_init(g);
+}
+
+// Deep copy, e.g. so a search thread can extend its own record
+void game_copy(GameRecord *dst, const GameRecord *src)
+{
+    dst->size = 0;
+    for (int i = 0; i < src->size; i++)
+        game_push(dst, src->keys[i], i > 0 ? &src->moves[i - 1] : NULL);
+}
+
+// Start recording from the current position (the record is reset)
+void board_attach_game(Board *b, GameRecord *g)
+{
+    b->game = g;
+    g->size = 0;
+    game_push(g, b->key, NULL);
+}
+
+// Last move played into the current position, if the record has one (a null move does not count)
+int board_last_move(Board *b, Move *out)
+{
+    if (!b->game || b->game->size < 2)
+        return 0;
+    *out = b->game->moves[b->game->size - 2];
+    return !move_is_null(out);
+}
+
+// How many times the current position occurred before. Only positions with the
+// same side to move since the last capture or pawn move can match.
+int board_repetitions(Board *b)
+{
+    if (!b->game)
+        return 0;
+    const uint64_t *keys = b->game->keys;
+    int count = 0;
+    int last = b->game->size - 1;
+    int stop = last - b->rule50;
+    if (stop < 0)
+        stop = 0;
+    for (int i = last - 2; i >= stop; i -= 2)
     {
-        int dirs[4][2] = {{-1, -1}, {-1, 1}, {1, -1}, {1, 1}};
-        for (int d = 0; d < 4; d++)
-        {
-            int nx = x + dirs[d][0], ny = y + dirs[d][1];
-            while (nx >= 0 && nx < 8 && ny >= 0 && ny < 8)
-            {
-                append_pos(out, out_count, nx, ny);
-                if (b->cells[nx][ny].state != 'E')
-                    break;
-                nx += dirs[d][0];
-                ny += dirs[d][1];
-            }
-        }
-        if (piece == 'B')
-            return;
+        if (keys[i] == b->key)
+            count++;
     }
-    if (piece == 'R' || piece == 'Q')
+    return count;
+}
+
+int board_threefold(Board *b)
+{
+    return board_repetitions(b) >= 2;
+}
+
+void get_attack_squares(Board *b, int x, int y, Pos *out, int *out_count)
+{
+    *out_count = 0;
+    int sq = SQ(x, y);
+    int p = b->squares[sq];
+    if (p == NO_PIECE)
+        return;
+
+    Bitboard occ = board_occupied(b), att = 0;
+    switch (piece_type(p))
     {
-        int dirs[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
-        for (int d = 0; d < 4; d++)
-        {
-            int nx = x + dirs[d][0], ny = y + dirs[d][1];
-            while (nx >= 0 && nx < 8 && ny >= 0 && ny < 8)
-            {
-                append_pos(out, out_count, nx, ny);
-                if (b->cells[nx][ny].state != 'E')
-                    break;
-                nx += dirs[d][0];
-                ny += dirs[d][1];
-            }
-        }
-        if (piece == 'R')
-            return;
+    case PAWN:
+        att = pawn_attacks[piece_color(p)][sq];
+        break;
+    case KNIGHT:
+        att = knight_attacks[sq];
+        break;
+    case BISHOP:
+        att = bishop_attacks_from(sq, occ);
+        break;
+    case ROOK:
+        att = rook_attacks_from(sq, occ);
+        break;
+    case QUEEN:
+        att = queen_attacks_from(sq, occ);
+        break;
+    case KING:
+        att = king_attacks[sq];
+        break;
     }
-    if (piece == 'K')
+    while (att)
     {
-        for (int dx = -1; dx <= 1; dx++)
-        {
-            for (int dy = -1; dy <= 1; dy++)
-            {
-                if (dx == 0 && dy == 0)
-                    continue;
-                int nx = x + dx, ny = y + dy;
-                if (nx >= 0 && nx < 8 && ny >= 0 && ny < 8)
-                    append_pos(out, out_count, nx, ny);
-            }
-        }
-        return;
+        int t = pop_lsb(&att);
+        append_pos(out, out_count, SQ_X(t), SQ_Y(t));
     }
 }
 
 int count_pieces(Board *b)
 {
-    int count = 0;
-    for (int i = 0; i < 8; i++)
-    {
-        for (int j = 0; j < 8; j++)
-        {
-            if (b->cells[i][j].state != 'E')
-                count++;
-        }
-    }
-    return count;
+    return popcount(board_occupied(b));
 }
 
 int adaptive_depth(Board *b)
@@ -2,25 +2,65 @@
 #define BOARD_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+typedef uint64_t Bitboard;
+
+// Square index: x * 8 + y, so a8 = 0 and h1 = 63 (x = row from the top, y = file)
+#define SQ(x, y) ((x) * 8 + (y))
+#define SQ_X(sq) ((sq) >> 3)
+#define SQ_Y(sq) ((sq) & 7)
+#define BIT(sq) (1ULL << (sq))
+#define NO_SQUARE 64
+
+enum
+{
+    WHITE,
+    BLACK
+};
+enum
+{
+    PAWN,
+    KNIGHT,
+    BISHOP,
+    ROOK,
+    QUEEN,
+    KING
+};
+
+// Mailbox piece code: 0 = empty, otherwise 1 + type + 8 * color
+#define NO_PIECE 0
+
 typedef struct
 {
     char state; // 'W', 'B', or 'E'
     char piece; // 'P','R','N','B','Q','K' or 0
 } Cell;
 
+// Castling rights bits
+#define CASTLE_WK 1
+#define CASTLE_WQ 2
+#define CASTLE_BK 4
+#define CASTLE_BQ 8
+
+typedef struct GameRecord GameRecord;
+
+// Search state only: a few cache lines, cheap to copy per thread or per game
 typedef struct
 {
-    Cell cells[8][8];
-    int castling_W_K, castling_W_Q, castling_B_K, castling_B_Q;
-    struct
-    {
-        char key[512];
-        int count;
-    } history[8192];
-    int history_size;
-    // Track last move to prevent immediate undo
-    int last_from_x, last_from_y, last_to_x, last_to_y;
-    int has_last_move;
+    Bitboard pieces[6];        // one set per piece type (both colors)
+    Bitboard colors[2];        // one set per color
+    uint64_t key;              // Zobrist hash: pieces, castling rights, en passant file, side to move
+    int eval_mg;               // material + piece-square sum, White minus Black, middlegame tables
+    int eval_eg;               // the same with endgame tables
+    int phase;                 // PHASE_WEIGHT sum of the pieces on the board (PHASE_MAX at the start)
+    unsigned char squares[64]; // mailbox for O(1) "what is on this square"
+    signed char king_sq[2];    // cached king squares (NO_SQUARE if absent)
+    unsigned char castling;    // CASTLE_* bits still available
+    unsigned char side;        // WHITE or BLACK to move
+    int ep_square;             // en passant target square, set only if a pawn can capture there
+    int rule50;                // plies since the last capture or pawn move
+    GameRecord *game;          // repetition keys and moves played (NULL = not tracked)
 } Board;
 
 typedef struct
@@ -30,21 +70,174 @@ typedef struct
 typedef struct
 {
     int from_x, from_y, to_x, to_y;
+    char promo; // 'Q','R','B','N' for promotions; 0 auto-queens
+    int score;  // ordering score inside a move list (ignored by move_equal)
 } Move;
 
+// Growable per-game record, kept outside Board. make_move appends, undo_move truncates.
+struct GameRecord
+{
+    uint64_t *keys; // key of every position so far, current one last
+    Move *moves;    // moves[i] leads from keys[i] to keys[i + 1]
+    int size;       // number of keys
+    int capacity;
+};
+
+typedef struct
+{
+    unsigned char to;   // mailbox piece captured on the target square (NO_PIECE if none)
+    unsigned char from; // mailbox piece that moved
+    // Extra for full reversibility:
+    int castling;
+    int did_castle;        // 0 no, 1 kingside, -1 queenside
+    int rook_fx, rook_fy;  // rook from (for castling)
+    int rook_tx, rook_ty;  // rook to   (for castling)
+    int did_promo;         // 1 if we promoted a pawn
+    char promo_prev_piece; // original piece before promotion (should be 'P')
+    int did_ep;            // 1 if the move captured en passant
+    int ep_square;         // en passant square before the move
+    uint64_t key;          // Zobrist key before the move
+    int rule50;
+    int game_size;
+} Snapshot;
+
+#define STARTPOS_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+static const char PIECE_CHARS[6] = {'P', 'N', 'B', 'R', 'Q', 'K'};
+
+// Game phase contribution per piece type; tapered evaluation blends mg/eg by it
+static const int PHASE_WEIGHT[6] = {0, 1, 1, 2, 4, 0};
+#define PHASE_MAX 24
+
 static inline char opposite_color(char c) { return c == 'W' ? 'B' : 'W'; }
+static inline int color_index(char c) { return c == 'B' ? BLACK : WHITE; }
+static inline char color_char(int c) { return c == BLACK ? 'B' : 'W'; }
+
+static inline int piece_index(char p)
+{
+    switch (p)
+    {
+    case 'P':
+        return PAWN;
+    case 'N':
+        return KNIGHT;
+    case 'B':
+        return BISHOP;
+    case 'R':
+        return ROOK;
+    case 'Q':
+        return QUEEN;
+    case 'K':
+        return KING;
+    }
+    return -1;
+}
+
+static inline int move_equal(const Move *a, const Move *b)
+{
+    return a->from_x == b->from_x && a->from_y == b->from_y &&
+           a->to_x == b->to_x && a->to_y == b->to_y && a->promo == b->promo;
+}
+
+// The empty move pushed by make_null_move (from == to)
+static inline int move_is_null(const Move *m)
+{
+    return m->from_x == m->to_x && m->from_y == m->to_y;
+}
+
+static inline int make_piece(int color, int type) { return 1 + type + (color << 3); }
+static inline int piece_type(int p) { return (p & 7) - 1; }
+static inline int piece_color(int p) { return p >> 3; }
+
+static inline int popcount(Bitboard b) { return __builtin_popcountll(b); }
+static inline int lsb(Bitboard b) { return __builtin_ctzll(b); }
+static inline int pop_lsb(Bitboard *b)
+{
+    int sq = __builtin_ctzll(*b);
+    *b &= *b - 1;
+    return sq;
+}
+
+// Zobrist tables, indexed by mailbox piece code / castling rights mask / en passant file
+extern uint64_t zobrist_piece[16][64];
+extern uint64_t zobrist_castling[16];
+extern uint64_t zobrist_ep[8];
+extern uint64_t zobrist_side;
+
+// Signed (White positive) material + piece-square values, indexed by mailbox piece code
+extern int psq_mg[16][64];
+extern int psq_eg[16][64];
+
+static inline Bitboard board_occupied(const Board *b) { return b->colors[WHITE] | b->colors[BLACK]; }
+static inline Bitboard board_pieces(const Board *b, int color, int type) { return b->pieces[type] & b->colors[color]; }
+
+// Low-level placement: keep bitboards, mailbox, hash and evaluation sums in sync
+static inline void board_put(Board *b, int sq, int piece)
+{
+    b->squares[sq] = (unsigned char)piece;
+    b->pieces[piece_type(piece)] |= BIT(sq);
+    b->colors[piece_color(piece)] |= BIT(sq);
+    b->key ^= zobrist_piece[piece][sq];
+    b->eval_mg += psq_mg[piece][sq];
+    b->eval_eg += psq_eg[piece][sq];
+    b->phase += PHASE_WEIGHT[piece_type(piece)];
+    if (piece_type(piece) == KING)
+        b->king_sq[piece_color(piece)] = sq;
+}
+
+static inline void board_remove(Board *b, int sq)
+{
+    int piece = b->squares[sq];
+    b->squares[sq] = NO_PIECE;
+    b->pieces[piece_type(piece)] &= ~BIT(sq);
+    b->colors[piece_color(piece)] &= ~BIT(sq);
+    b->key ^= zobrist_piece[piece][sq];
+    b->eval_mg -= psq_mg[piece][sq];
+    b->eval_eg -= psq_eg[piece][sq];
+    b->phase -= PHASE_WEIGHT[piece_type(piece)];
+    if (piece_type(piece) == KING)
+        b->king_sq[piece_color(piece)] = NO_SQUARE;
+}
+
+static inline void board_move(Board *b, int from, int to)
+{
+    int piece = b->squares[from];
+    Bitboard ft = BIT(from) | BIT(to);
+    b->squares[from] = NO_PIECE;
+    b->squares[to] = (unsigned char)piece;
+    b->pieces[piece_type(piece)] ^= ft;
+    b->colors[piece_color(piece)] ^= ft;
+    b->key ^= zobrist_piece[piece][from] ^ zobrist_piece[piece][to];
+    b->eval_mg += psq_mg[piece][to] - psq_mg[piece][from];
+    b->eval_eg += psq_eg[piece][to] - psq_eg[piece][from];
+    if (piece_type(piece) == KING)
+        b->king_sq[piece_color(piece)] = to;
+}
 
 void board_init(Board *b);
+int board_set_fen(Board *b, const char *fen);
 void board_set_piece(Board *b, int x, int y, char piece, char color);
+Cell board_cell(const Board *b, int x, int y);
 void board_apply_move(Board *b, int from_x, int from_y, int to_x, int to_y);
+void board_play_move(Board *b, const Move *m);
+void make_move(Board *b, const Move *m, Snapshot *snap);
+void undo_move(Board *b, const Move *m, Snapshot *snap);
+void make_null_move(Board *b, Snapshot *snap);
+void undo_null_move(Board *b, Snapshot *snap);
 int board_find_king(Board *b, char color, int *outx, int *outy);
 int board_is_in_check(Board *b, char color);
 int board_is_checkmate(Board *b, char color);
 int board_is_stalemate(Board *b, char color);
 int board_can_castle(Board *b, char color, char side);
-void position_key(Board *b, char color_to_move, char *out, size_t out_sz);
-void history_increment(Board *b, const char *key);
-int board_threefold(Board *b, char color_to_move);
+void board_update_castling(Board *b, int from, int to);
+uint64_t position_key(Board *b);
+void game_init(GameRecord *g);
+void game_free(GameRecord *g);
+void game_copy(GameRecord *dst, const GameRecord *src);
+void board_attach_game(Board *b, GameRecord *g);
+int board_last_move(Board *b, Move *out);
+int board_repetitions(Board *b);
+int board_threefold(Board *b);
 void get_attack_squares(Board *b, int x, int y, Pos *out, int *out_count);
 int count_pieces(Board *b);
 int adaptive_depth(Board *b);
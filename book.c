@@ -0,0 +1,225 @@
+#include "book.h"
+#include "ai.h"
+#include "util.h"
+#include "polyglot_keys.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#define BOOK_ENTRY_SIZE 16
+#define BOOK_MAX_MOVES 64
+
+static const unsigned char *book_data = NULL;
+static size_t book_size = 0; // bytes
+static size_t book_entries = 0;
+static int book_mode = BOOK_WEIGHTED;
+static int book_max_ply = 0;
+static uint64_t book_rng = 0;
+
+static uint64_t read_be(const unsigned char *p, int bytes)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++)
+        v = v << 8 | p[i];
+    return v;
+}
+
+// Pieces, castling rights, en passant file and side to move. Polyglot counts ranks from
+// White's side (a1 = 0), so its square is ours with the rank flipped: sq ^ 56.
+uint64_t polyglot_key(const Board *b)
+{
+    uint64_t key = 0;
+    Bitboard occ = board_occupied(b);
+    while (occ)
+    {
+        int sq = pop_lsb(&occ);
+        int p = b->squares[sq];
+        int kind = 2 * piece_type(p) + (piece_color(p) == WHITE);
+        key ^= polyglot_random64[64 * kind + (sq ^ 56)];
+    }
+    static const int rights[4] = {CASTLE_WK, CASTLE_WQ, CASTLE_BK, CASTLE_BQ};
+    for (int i = 0; i < 4; i++)
+        if (b->castling & rights[i])
+            key ^= polyglot_random64[768 + i];
+    // Polyglot only hashes the file when a pawn can take en passant, as ep_square does
+    if (b->ep_square != NO_SQUARE)
+        key ^= polyglot_random64[772 + SQ_Y(b->ep_square)];
+    if (b->side == WHITE)
+        key ^= polyglot_random64[780];
+    return key;
+}
+
+// Key of the start position given by the format specification
+#define POLYGLOT_STARTPOS_KEY 0x463B96181691FC9CULL
+
+int book_open(const char *path)
+{
+    book_close();
+
+    // A damaged key table would make every probe miss without a word
+    static Board start;
+    board_set_fen(&start, STARTPOS_FEN);
+    if (polyglot_key(&start) != POLYGLOT_STARTPOS_KEY)
+    {
+        fprintf(stderr, "book: Polyglot key table check failed, cannot read %s\n", path);
+        return 0;
+    }
+#ifdef _WIN32
+    // No mmap: read the whole file instead
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return 0;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *data = size > 0 ? (unsigned char *)malloc((size_t)size) : NULL;
+    if (!data || fread(data, 1, (size_t)size, f) != (size_t)size)
+    {
+        free(data);
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < BOOK_ENTRY_SIZE)
+    {
+        close(fd);
+        return 0;
+    }
+    off_t size = st.st_size;
+    void *data = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid
+    if (data == MAP_FAILED)
+        return 0;
+#endif
+    book_data = (const unsigned char *)data;
+    book_size = (size_t)size;
+    book_entries = book_size / BOOK_ENTRY_SIZE;
+    if (!book_rng)
+        book_rng = (uint64_t)now_ms() | 1;
+    return 1;
+}
+
+void book_close(void)
+{
+    if (!book_data)
+        return;
+#ifdef _WIN32
+    free((void *)book_data);
+#else
+    munmap((void *)book_data, book_size);
+#endif
+    book_data = NULL;
+    book_size = book_entries = 0;
+}
+
+int book_loaded(void)
+{
+    return book_data != NULL;
+}
+
+void book_set_mode(int mode)
+{
+    book_mode = mode;
+}
+
+void book_set_max_ply(int plies)
+{
+    book_max_ply = plies;
+}
+
+// Polyglot move: to file | to row << 3 | from file << 6 | from row << 9 | promotion << 12
+// (1 = knight .. 4 = queen). Castling is written as the king taking its own rook.
+static Move decode_move(const Board *b, unsigned raw)
+{
+    int to = ((raw & 7) | ((raw >> 3) & 7) << 3) ^ 56;
+    int from = (((raw >> 6) & 7) | ((raw >> 9) & 7) << 3) ^ 56;
+    static const char promos[5] = {0, 'N', 'B', 'R', 'Q'};
+    int promo = (raw >> 12) & 7;
+    Move m = {.from_x = SQ_X(from), .from_y = SQ_Y(from), .to_x = SQ_X(to), .to_y = SQ_Y(to),
+              .promo = promo <= 4 ? promos[promo] : 0};
+
+    int piece = b->squares[from];
+    if (piece != NO_PIECE && piece_type(piece) == KING && b->squares[to] == make_piece(piece_color(piece), ROOK))
+        m.to_y = m.to_y > m.from_y ? 6 : 2;
+    return m;
+}
+
+// A legal book move for the position, or 0 (no book, past the maximum ply, or not in the book)
+int book_probe(Board *b, Move *out)
+{
+    if (!book_data)
+        return 0;
+    int plies = b->game ? b->game->size - 1 : 0;
+    if (book_max_ply > 0 && plies >= book_max_ply)
+        return 0;
+
+    // First entry with this key
+    uint64_t key = polyglot_key(b);
+    size_t lo = 0, hi = book_entries;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (read_be(book_data + mid * BOOK_ENTRY_SIZE, 8) < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    Move legal[256], found[BOOK_MAX_MOVES];
+    unsigned weights[BOOK_MAX_MOVES];
+    int n_legal = 0, n = 0;
+    unsigned long total = 0;
+    collect_legal_moves(b, color_char(b->side), legal, &n_legal);
+    for (size_t i = lo; i < book_entries && n < BOOK_MAX_MOVES; i++)
+    {
+        const unsigned char *e = book_data + i * BOOK_ENTRY_SIZE;
+        if (read_be(e, 8) != key)
+            break;
+        unsigned weight = (unsigned)read_be(e + 10, 2);
+        if (weight == 0)
+            continue; // kept in the book but never to be played
+        Move m = decode_move(b, (unsigned)read_be(e + 8, 2));
+        for (int j = 0; j < n_legal; j++)
+        {
+            // Our generator leaves promo 0 on non-promotions, like the book
+            if (move_equal(&m, &legal[j]))
+            {
+                found[n] = legal[j];
+                weights[n++] = weight;
+                total += weight;
+                break;
+            }
+        }
+    }
+    if (n == 0)
+        return 0;
+
+    int pick = 0;
+    if (book_mode == BOOK_BEST)
+    {
+        for (int i = 1; i < n; i++)
+            if (weights[i] > weights[pick])
+                pick = i;
+    }
+    else
+    {
+        // xorshift64: independent of rand() so callers' sequences are not disturbed
+        book_rng ^= book_rng << 13;
+        book_rng ^= book_rng >> 7;
+        book_rng ^= book_rng << 17;
+        unsigned long r = (unsigned long)(book_rng % total);
+        while (r >= weights[pick])
+            r -= weights[pick++];
+    }
+    *out = found[pick];
+    return 1;
+}
@@ -0,0 +1,22 @@
+#ifndef BOOK_H
+#define BOOK_H
+#include "board.h"
+
+// Polyglot opening book (.bin): 16-byte big-endian entries {key, move, weight, learn},
+// sorted by key. The file is memory-mapped and searched in place.
+
+enum
+{
+    BOOK_WEIGHTED, // pick among the book moves at random, in proportion to their weights
+    BOOK_BEST      // always the highest-weighted move
+};
+
+int book_open(const char *path); // 1 on success; replaces any open book
+void book_close(void);
+int book_loaded(void);
+void book_set_mode(int mode);
+void book_set_max_ply(int plies); // stop using the book after this many plies of the game (0 = never)
+int book_probe(Board *b, Move *out);
+uint64_t polyglot_key(const Board *b);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "epd.h"
+#include "util.h"
+
+// Copy the next whitespace-separated field to out (at most n - 1 characters); returns the
+// position after it
+static const char *next_field(const char *p, char *out, size_t n)
+{
+    while (*p && isspace((unsigned char)*p))
+        p++;
+    size_t len = 0;
+    for (; *p && !isspace((unsigned char)*p); p++)
+        if (len + 1 < n)
+            out[len++] = *p;
+    out[len] = 0;
+    return p;
+}
+
+// Operand of one operation, quotes removed
+static void copy_operand(const char *p, const char *end, char *out, size_t n)
+{
+    while (p < end && isspace((unsigned char)*p))
+        p++;
+    while (end > p && isspace((unsigned char)end[-1]))
+        end--;
+    if (end - p >= 2 && *p == '"' && end[-1] == '"')
+    {
+        p++;
+        end--;
+    }
+    size_t len = (size_t)(end - p) < n - 1 ? (size_t)(end - p) : n - 1;
+    memcpy(out, p, len);
+    out[len] = 0;
+}
+
+// Move list operand (bm, am): legal moves in SAN or coordinate notation, space separated
+static int parse_moves(Board *b, const char *p, const char *end, Move *out)
+{
+    char list[128], word[16];
+    copy_operand(p, end, list, sizeof(list));
+    int n = 0;
+    for (const char *q = next_field(list, word, sizeof(word)); word[0] && n < EPD_MAX_MOVES;
+         q = next_field(q, word, sizeof(word)))
+        if (parse_san(b, word, &out[n]))
+            n++;
+    return n;
+}
+
+int epd_parse(const char *line, EpdPosition *out)
+{
+    memset(out, 0, sizeof(*out));
+    const char *p = line;
+    while (*p && isspace((unsigned char)*p))
+        p++;
+    if (!*p || *p == '#')
+        return 0;
+
+    // Placement, side, castling, en passant, then the FEN counters if they are there
+    char field[96];
+    size_t len = 0;
+    for (int f = 0; f < 6; f++)
+    {
+        const char *after = next_field(p, field, sizeof(field));
+        if (!field[0] || (f >= 4 && !isdigit((unsigned char)field[0])))
+            break;
+        len += snprintf(out->fen + len, sizeof(out->fen) - len, "%s%s", f ? " " : "", field);
+        if (len >= sizeof(out->fen))
+            return 0;
+        p = after;
+    }
+    if (!board_set_fen(&out->board, out->fen))
+        return 0;
+
+    // Operations
+    while (*p)
+    {
+        const char *end = p;
+        int quoted = 0;
+        while (*end && (quoted || *end != ';'))
+        {
+            if (*end == '"')
+                quoted = !quoted;
+            end++;
+        }
+        char opcode[16];
+        const char *operand = next_field(p, opcode, sizeof(opcode));
+        if (operand > end)
+            operand = end;
+        if (strcmp(opcode, "id") == 0)
+            copy_operand(operand, end, out->id, sizeof(out->id));
+        else if (strcmp(opcode, "bm") == 0)
+            out->n_bm = parse_moves(&out->board, operand, end, out->bm);
+        else if (strcmp(opcode, "am") == 0)
+            out->n_am = parse_moves(&out->board, operand, end, out->am);
+        p = *end ? end + 1 : end;
+    }
+    return 1;
+}
@@ -0,0 +1,24 @@
+#ifndef EPD_H
+#define EPD_H
+#include "board.h"
+
+// EPD and FEN lines: the four position fields, optionally the two FEN counters, then
+// EPD operations "opcode operand...;" such as id "WAC.001"; or bm Qg6;
+
+#define EPD_MAX_MOVES 8
+
+typedef struct
+{
+    Board board;
+    char fen[128]; // the position fields as read (with the counters, if given)
+    char id[64];   // "id" operand without its quotes, empty if none
+    Move bm[EPD_MAX_MOVES]; // "bm" best moves (legal moves only; SAN or coordinates in the file)
+    int n_bm;
+    Move am[EPD_MAX_MOVES]; // "am" moves to avoid
+    int n_am;
+} EpdPosition;
+
+// 1 if the line holds a valid position; blank lines and lines starting with '#' give 0
+int epd_parse(const char *line, EpdPosition *out);
+
+#endif
\ No newline at end of file
@@ -2,22 +2,81 @@
 #include "move_gen.h"
 #include "ai.h"
 #include "util.h"
+#include "perft.h"
+#include "bench.h"
+#include "uci.h"
+#include "book.h"
+#include "tb.h"
+#include "bitbase.h"
+#include "analyze.h"
+#include "suite.h"
+#include "match.h"
 
-int main()
+int main(int argc, char **argv)
 {
 #ifdef _WIN32
     // Enable UTF-8 on Windows console
     SetConsoleOutputCP(CP_UTF8);
 #endif
 
+    // Non-interactive modes
+    if (argc > 1 && (strcmp(argv[1], "perft") == 0 || strcmp(argv[1], "divide") == 0))
+        return perft_command(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "uci") == 0)
+        return uci_loop(NULL);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return bench_command(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "analyze") == 0)
+        return analyze_command(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "suite") == 0)
+        return suite_command(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "match") == 0)
+        return match_command(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "tbcheck") == 0)
+        return tb_check_command(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "bitbases") == 0)
+    {
+        if (argc < 3)
+        {
+            printf("usage: bitbases FILE [threads]\n");
+            return 1;
+        }
+        return bitbase_generate(argv[2], argc > 3 ? atoi(argv[3]) : BITBASE_THREADS) ? 0 : 1;
+    }
+
+    // Interactive game options: --threads N, --book FILE, --book-depth PLIES, --book-best,
+    // --syzygy DIRS, --bitbases FILE
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            search_set_threads(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--book") == 0 && i + 1 < argc)
+        {
+            if (!book_open(argv[++i]))
+                printf("Cannot open book %s, playing without it.\n", argv[i]);
+        }
+        else if (strcmp(argv[i], "--book-depth") == 0 && i + 1 < argc)
+            book_set_max_ply(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--book-best") == 0)
+            book_set_mode(BOOK_BEST);
+        else if (strcmp(argv[i], "--syzygy") == 0 && i + 1 < argc)
+        {
+            if (!tb_init(argv[++i]))
+                printf("No tablebases found in %s.\n", argv[i]);
+        }
+        else if (strcmp(argv[i], "--bitbases") == 0 && i + 1 < argc)
+        {
+            if (!bitbase_init(argv[++i], BITBASE_THREADS))
+                printf("Cannot open or build bitbases %s, playing without them.\n", argv[i]);
+        }
+    }
+
     Board board;
+    GameRecord game;
     board_init(&board);
+    game_init(&game);
+    board_attach_game(&board, &game);
 
-    // pre-record initial position for threefold next side move ('W' begins)
-    char init_key[512];
-    position_key(&board, 'W', init_key, sizeof(init_key));
-    history_increment(&board, init_key);
-    
     // Ask player to choose color
     char player_color = 'W';
     printf("Welcome to Chess Engine!\n");
@@ -25,6 +84,12 @@ int main()
     char color_buf[64];
     if (input_line(color_buf, sizeof(color_buf)))
     {
+        // A GUI or match runner talking UCI starts with "uci" instead of a color
+        if (strcmp(color_buf, "uci") == 0)
+        {
+            game_free(&game);
+            return uci_loop(color_buf);
+        }
         if (color_buf[0] == 'B' || color_buf[0] == 'b')
         {
             player_color = 'B';
@@ -72,8 +137,10 @@ int main()
         // ask for a piece with at least one legal move
         while (1)
         {
-            double ev = evaluate_board(&board, player_color);
-            printf("Board evaluation of %s: %.2f\n", (player_color == 'W') ? "White" : "Black", ev);
+            int ev = evaluate_board(&board);
+            if (player_color == 'B')
+                ev = -ev;
+            printf("Board evaluation of %s: %d\n", (player_color == 'W') ? "White" : "Black", ev);
             char ai_color = opposite_color(player_color);
             int depthW = adaptive_depth(&board);
             printf("[AI] Using adaptive depth = %d (moves: %d, phase:%.2f)\n",
@@ -88,16 +155,14 @@ int main()
                 printf("Invalid input. Try again.\n");
                 continue;
             }
-            if (board.cells[from_x][from_y].state != player_color)
+            if (board_cell(&board, from_x, from_y).state != player_color)
             {
                 printf("That's not a %s piece. Try again.\n", (player_color == 'W') ? "white" : "black");
                 continue;
             }
-            Pos ps[64];
-            int pn = 0, ln = 0;
-            get_available_moves(&board, from_x, from_y, 1, ps, &pn);
             Pos leg[64];
-            filter_legal_moves(&board, from_x, from_y, ps, pn, player_color, leg, &ln);
+            int ln = 0;
+            get_legal_moves(&board, from_x, from_y, leg, &ln);
             if (ln == 0)
             {
                 printf("No legal moves for that piece. Try another.\n");
@@ -185,5 +250,6 @@ int main()
         }
     }
 
+    game_free(&game);
     return 0;
 }
@@ -0,0 +1,651 @@
+#include "match.h"
+#include "epd.h"
+#include "move_gen.h"
+#include "tt.h"
+#include "tb.h"
+#include "bitbase.h"
+#include "util.h"
+#include <pthread.h>
+
+// Games are handed out in pairs: game 2k and 2k + 1 start from the same opening with
+// the colors reversed, which cancels most of the bias of an unbalanced opening. Each
+// worker owns one Searcher per engine and plays its games start to finish; results are
+// folded into the shared statistics as they come in, and the match stops early once the
+// SPRT reaches a verdict.
+
+#define MATCH_MAX_OPENING_PLIES 64
+#define MATCH_RANDOM_OPENING_PLIES 8 // random moves from the start position when no openings are given
+
+typedef struct
+{
+    char fen[128];
+    Move moves[MATCH_MAX_OPENING_PLIES]; // played from fen to reach the opening position
+    int n_moves;
+} Opening;
+
+enum
+{
+    END_CHECKMATE,
+    END_STALEMATE,
+    END_THREEFOLD,
+    END_FIFTY_MOVES,
+    END_MATERIAL,
+    END_ADJUDICATED_WIN,
+    END_ADJUDICATED_DRAW,
+    END_MAX_PLIES
+};
+
+static const char *END_NAMES[] = {
+    "checkmate", "stalemate", "threefold repetition", "50-move rule", "insufficient material",
+    "adjudicated win", "adjudicated draw", "ply limit",
+};
+
+static const int MATCH_DEFAULT_MOVETIME = 100; // ms per move for an engine given no limit
+
+typedef struct
+{
+    const MatchConfig *cfg;
+    Opening *openings;
+    int n_openings;
+    int next_game;
+    int stop; // SPRT verdict reached
+    int wins, draws, losses; // engine A's results
+    long long start_ms;
+    pthread_mutex_t lock;
+} MatchState;
+
+// ---- openings ----
+
+static int add_opening(Opening **list, int *n, int *cap, const Opening *o)
+{
+    if (*n == *cap)
+    {
+        int grown = *cap ? *cap * 2 : 64;
+        Opening *bigger = (Opening *)realloc(*list, (size_t)grown * sizeof(Opening));
+        if (!bigger)
+            return 0;
+        *list = bigger;
+        *cap = grown;
+    }
+    (*list)[(*n)++] = *o;
+    return 1;
+}
+
+static int load_epd_openings(FILE *f, Opening **list, int *n)
+{
+    int cap = 0;
+    char line[1024];
+    EpdPosition pos;
+    Opening o;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (!epd_parse(line, &pos))
+            continue;
+        memset(&o, 0, sizeof(o));
+        strcpy(o.fen, pos.fen);
+        if (!add_opening(list, n, &cap, &o))
+            return 0;
+    }
+    return 1;
+}
+
+// PGN: tag pairs (only [FEN] is used), then SAN movetext up to the result. Comments,
+// variations, NAGs and move numbers are skipped; openings longer than
+// MATCH_MAX_OPENING_PLIES are cut there.
+static int load_pgn_openings(FILE *f, Opening **list, int *n)
+{
+    int cap = 0, c;
+    Opening o;
+    Board board;
+    int in_game = 0, bad = 0;
+    char token[256];
+
+    memset(&o, 0, sizeof(o));
+    strcpy(o.fen, STARTPOS_FEN);
+    board_set_fen(&board, o.fen);
+    while ((c = fgetc(f)) != EOF)
+    {
+        if (isspace(c))
+            continue;
+        if (c == '[')
+        {
+            // Tag pair; a tag after movetext starts the next game
+            int len = 0;
+            while ((c = fgetc(f)) != EOF && c != ']')
+                if (len + 1 < (int)sizeof(token))
+                    token[len++] = (char)c;
+            token[len] = 0;
+            if (in_game)
+            {
+                if (!bad && !add_opening(list, n, &cap, &o))
+                    return 0;
+                memset(&o, 0, sizeof(o));
+                strcpy(o.fen, STARTPOS_FEN);
+                board_set_fen(&board, o.fen);
+                in_game = bad = 0;
+            }
+            if (strncmp(token, "FEN ", 4) == 0)
+            {
+                char *q = strchr(token, '"');
+                char *end = q ? strchr(q + 1, '"') : NULL;
+                if (end && end - q - 1 < (int)sizeof(o.fen))
+                {
+                    memcpy(o.fen, q + 1, (size_t)(end - q - 1));
+                    o.fen[end - q - 1] = 0;
+                    bad = !board_set_fen(&board, o.fen);
+                }
+            }
+            continue;
+        }
+        if (c == '{')
+        {
+            while ((c = fgetc(f)) != EOF && c != '}')
+                ;
+            continue;
+        }
+        if (c == ';')
+        {
+            while ((c = fgetc(f)) != EOF && c != '\n')
+                ;
+            continue;
+        }
+        if (c == '(')
+        {
+            for (int depth = 1; depth > 0 && (c = fgetc(f)) != EOF;)
+                depth += (c == '(') - (c == ')');
+            continue;
+        }
+
+        int len = 0;
+        token[len++] = (char)c;
+        while ((c = fgetc(f)) != EOF && !isspace(c) && !strchr("{}();[", c))
+            if (len + 1 < (int)sizeof(token))
+                token[len++] = (char)c;
+        token[len] = 0;
+        if (c != EOF && !isspace(c))
+            ungetc(c, f);
+
+        if (strcmp(token, "1-0") == 0 || strcmp(token, "0-1") == 0 || strcmp(token, "1/2-1/2") == 0 ||
+            strcmp(token, "*") == 0)
+        {
+            // Result: the game is complete
+            if (!bad && !add_opening(list, n, &cap, &o))
+                return 0;
+            memset(&o, 0, sizeof(o));
+            strcpy(o.fen, STARTPOS_FEN);
+            board_set_fen(&board, o.fen);
+            in_game = bad = 0;
+            continue;
+        }
+        in_game = 1;
+        if (token[0] == '$')
+            continue;
+        const char *san = token;
+        while (isdigit((unsigned char)*san))
+            san++;
+        if (san != token && *san != '.')
+            san = token; // not a move number after all
+        while (*san == '.')
+            san++;
+        Move m;
+        if (!*san || bad || o.n_moves >= MATCH_MAX_OPENING_PLIES)
+            continue;
+        if (!parse_san(&board, san, &m))
+        {
+            bad = 1;
+            continue;
+        }
+        board_play_move(&board, &m);
+        o.moves[o.n_moves++] = m;
+    }
+    if (in_game && !bad && !add_opening(list, n, &cap, &o))
+        return 0;
+    return 1;
+}
+
+// Without an openings file every pair starts from its own few random moves off the start
+// position: engines limited by depth or nodes would otherwise replay the same game
+static int random_openings(int n, Opening **list)
+{
+    *list = (Opening *)calloc(n, sizeof(Opening));
+    if (!*list)
+        return 0;
+    uint64_t rng = 0x2545F4914F6CDD1DULL;
+    for (int i = 0; i < n; i++)
+    {
+        Opening *o = &(*list)[i];
+        strcpy(o->fen, STARTPOS_FEN);
+        Board b;
+        board_set_fen(&b, o->fen);
+        o->n_moves = 0;
+        while (o->n_moves < MATCH_RANDOM_OPENING_PLIES)
+        {
+            Move moves[256];
+            int count = 0;
+            generate_legal_moves(&b, b.side, ~0ULL, 1, moves, &count);
+            if (count == 0)
+            {
+                // a random line into mate or stalemate: start this one over
+                board_set_fen(&b, o->fen);
+                o->n_moves = 0;
+                continue;
+            }
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            o->moves[o->n_moves] = moves[rng % count];
+            board_play_move(&b, &o->moves[o->n_moves++]);
+        }
+    }
+    return 1;
+}
+
+static int load_openings(const char *path, Opening **list, int *n)
+{
+    *list = NULL;
+    *n = 0;
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    size_t len = strlen(path);
+    int pgn = len > 4 && (strcmp(path + len - 4, ".pgn") == 0 || strcmp(path + len - 4, ".PGN") == 0);
+    int ok = pgn ? load_pgn_openings(f, list, n) : load_epd_openings(f, list, n);
+    fclose(f);
+    return ok && *n > 0;
+}
+
+// ---- statistics ----
+
+// Scores are kept within (0.001, 0.999), about +-1200 Elo: a one-sided result or an
+// interval reaching past 0 or 1 still prints as a number
+static double elo_from_score(double score)
+{
+    const double MIN_SCORE = 0.001;
+    if (score < MIN_SCORE)
+        score = MIN_SCORE;
+    if (score > 1.0 - MIN_SCORE)
+        score = 1.0 - MIN_SCORE;
+    return 400.0 * log10(score / (1.0 - score));
+}
+
+static double score_from_elo(double elo)
+{
+    return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+}
+
+// Mean score and per-game variance of engine A's results
+static void score_stats(double w, double d, double l, double *mean, double *var)
+{
+    double n = w + d + l;
+    *mean = (w + 0.5 * d) / n;
+    *var = (w * (1.0 - *mean) * (1.0 - *mean) + d * (0.5 - *mean) * (0.5 - *mean) + l * (*mean) * (*mean)) / n;
+}
+
+// Log-likelihood ratio of H1 (elo1) against H0 (elo0): the generalized SPRT on the
+// win/draw/loss counts, with the normal approximation of the score. Undefined until the
+// results vary at all, so 0 before the first game or while every result is the same.
+static double sprt_llr(int w, int d, int l, double elo0, double elo1)
+{
+    if (w + d + l == 0)
+        return 0.0;
+    double mean, var;
+    score_stats(w, d, l, &mean, &var);
+    if (var <= 0.0)
+        return 0.0;
+    double s0 = score_from_elo(elo0), s1 = score_from_elo(elo1);
+    return (w + d + l) * (s1 - s0) * (2.0 * mean - s0 - s1) / (2.0 * var);
+}
+
+// Prints the running result; returns 1 once the SPRT has decided
+static int report_stats(MatchState *st)
+{
+    const MatchConfig *cfg = st->cfg;
+    int w = st->wins, d = st->draws, l = st->losses, n = w + d + l;
+    double mean, var;
+    score_stats(w, d, l, &mean, &var);
+    double margin = 1.96 * sqrt(var / n); // 95% interval of the mean score
+    double elo = elo_from_score(mean);
+    double lo = elo_from_score(mean - margin), hi = elo_from_score(mean + margin);
+
+    double llr = sprt_llr(w, d, l, cfg->elo0, cfg->elo1);
+    double lower = log(cfg->beta / (1.0 - cfg->alpha)), upper = log((1.0 - cfg->beta) / cfg->alpha);
+    const char *verdict = llr >= upper ? "H1 accepted" : llr <= lower ? "H0 accepted" : "continue";
+
+    printf("  A vs B: +%d =%d -%d (%.1f%%)  Elo %.1f [%.1f, %.1f]  LLR %.2f [%.2f, %.2f] %s\n", w, d, l,
+           100.0 * mean, elo, lo, hi, llr, lower, upper, verdict);
+    fflush(stdout);
+    return llr >= upper || llr <= lower;
+}
+
+// ---- games ----
+
+static int insufficient_material(const Board *b)
+{
+    Bitboard minors = b->pieces[KNIGHT] | b->pieces[BISHOP];
+    return (board_occupied(b) & ~b->pieces[KING] & ~minors) == 0 && popcount(minors) <= 1;
+}
+
+// Play one game; returns 1, 0 or -1 for White and sets *reason and *plies (moves played
+// after the opening)
+static int play_game(const MatchConfig *cfg, Searcher **engines, int a_white, const Opening *o, Board *b,
+                     GameRecord *game, int *reason, int *plies)
+{
+    board_set_fen(b, o->fen);
+    board_attach_game(b, game);
+    for (int i = 0; i < o->n_moves; i++)
+        board_play_move(b, &o->moves[i]);
+    searcher_new_game(engines[0]);
+    searcher_new_game(engines[1]);
+
+    int resign_count = 0, resign_side = 0, draw_count = 0;
+    *plies = 0;
+    while (1)
+    {
+        int side = b->side;
+        int e = (side == WHITE) == a_white ? 0 : 1;
+        SearchResult r;
+        if (!searcher_search(engines[e], b, color_char(side), &cfg->engine[e].limits, &r))
+        {
+            int mated = is_square_attacked(b, b->king_sq[side], !side);
+            *reason = mated ? END_CHECKMATE : END_STALEMATE;
+            return mated ? (side == WHITE ? -1 : 1) : 0;
+        }
+        board_play_move(b, &r.best);
+        (*plies)++;
+
+        if (board_threefold(b))
+        {
+            *reason = END_THREEFOLD;
+            return 0;
+        }
+        if (b->rule50 >= 100 && count_legal_moves(b, color_char(b->side)) > 0) // mate still wins
+        {
+            *reason = END_FIFTY_MOVES;
+            return 0;
+        }
+        if (insufficient_material(b))
+        {
+            *reason = END_MATERIAL;
+            return 0;
+        }
+
+        // Score adjudication: r.score is from White's side, so both engines' views line up
+        int sign = r.score > 0 ? 1 : -1;
+        if (cfg->resign_score && abs(r.score) >= cfg->resign_score)
+        {
+            resign_count = sign == resign_side ? resign_count + 1 : 1;
+            resign_side = sign;
+            if (resign_count >= 2 * cfg->resign_moves)
+            {
+                *reason = END_ADJUDICATED_WIN;
+                return sign;
+            }
+        }
+        else
+            resign_count = 0;
+        if (cfg->draw_moves && *plies >= cfg->draw_min_ply && abs(r.score) <= cfg->draw_score)
+        {
+            if (++draw_count >= 2 * cfg->draw_moves)
+            {
+                *reason = END_ADJUDICATED_DRAW;
+                return 0;
+            }
+        }
+        else
+            draw_count = 0;
+
+        if (cfg->max_plies && *plies >= cfg->max_plies)
+        {
+            *reason = END_MAX_PLIES;
+            return 0;
+        }
+    }
+}
+
+static void *match_worker(void *arg)
+{
+    MatchState *st = (MatchState *)arg;
+    const MatchConfig *cfg = st->cfg;
+    Searcher *engines[2];
+    for (int e = 0; e < 2; e++)
+    {
+        engines[e] = searcher_new(cfg->engine[e].threads);
+        if (engines[e])
+        {
+            searcher_set_hash(engines[e], cfg->engine[e].hash_mb);
+            searcher_set_options(engines[e], &cfg->engine[e].options);
+        }
+    }
+    Board board;
+    GameRecord game;
+    game_init(&game);
+
+    while (engines[0] && engines[1])
+    {
+        pthread_mutex_lock(&st->lock);
+        int g = st->stop || st->next_game >= cfg->games ? -1 : st->next_game++;
+        pthread_mutex_unlock(&st->lock);
+        if (g < 0)
+            break;
+
+        const Opening *o = &st->openings[(g / 2) % st->n_openings];
+        int a_white = g % 2 == 0;
+        int reason, plies;
+        int result = play_game(cfg, engines, a_white, o, &board, &game, &reason, &plies);
+        int a_result = a_white ? result : -result;
+
+        pthread_mutex_lock(&st->lock);
+        st->wins += a_result > 0;
+        st->draws += a_result == 0;
+        st->losses += a_result < 0;
+        printf("game %d: %s-%s %s, %s, %d plies, opening %d  [%lld s]\n", g + 1, a_white ? "A" : "B",
+               a_white ? "B" : "A", result > 0 ? "1-0" : result < 0 ? "0-1" : "1/2-1/2", END_NAMES[reason], plies,
+               (g / 2) % st->n_openings + 1, (now_ms() - st->start_ms) / 1000);
+        if (report_stats(st) && !st->stop)
+        {
+            st->stop = 1;
+            printf("SPRT verdict reached, finishing the games in progress\n");
+        }
+        pthread_mutex_unlock(&st->lock);
+    }
+
+    game_free(&game);
+    searcher_free(engines[0]);
+    searcher_free(engines[1]);
+    return NULL;
+}
+
+void match_default_config(MatchConfig *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    for (int e = 0; e < 2; e++)
+    {
+        cfg->engine[e].threads = 1;
+        cfg->engine[e].hash_mb = TT_DEFAULT_MB;
+        cfg->engine[e].options = (SearchOptions){.null_move = 1, .lmr = 1, .aspiration = 1, .endgame_tables = 1};
+    }
+    cfg->games = 100;
+    cfg->concurrency = 1;
+    cfg->resign_score = 1000;
+    cfg->resign_moves = 3;
+    cfg->draw_score = 10;
+    cfg->draw_moves = 8;
+    cfg->draw_min_ply = 80;
+    cfg->max_plies = 400;
+    cfg->elo0 = 0.0;
+    cfg->elo1 = 5.0;
+    cfg->alpha = 0.05;
+    cfg->beta = 0.05;
+}
+
+int match_run(const MatchConfig *cfg)
+{
+    MatchState st;
+    memset(&st, 0, sizeof(st));
+    st.cfg = cfg;
+    MatchConfig run = *cfg;
+    run.games += run.games % 2;
+    if (cfg->openings)
+    {
+        if (!load_openings(cfg->openings, &st.openings, &st.n_openings))
+        {
+            printf("No openings found in %s\n", cfg->openings);
+            free(st.openings);
+            return 0;
+        }
+    }
+    else
+    {
+        st.n_openings = run.games / 2 > 0 ? run.games / 2 : 1;
+        if (!random_openings(st.n_openings, &st.openings))
+            return 0;
+        printf("No openings file: each pair starts with %d random plies from the initial position\n",
+               MATCH_RANDOM_OPENING_PLIES);
+    }
+    for (int e = 0; e < 2; e++)
+    {
+        SearchLimits *l = &run.engine[e].limits;
+        if (!l->depth && !l->nodes && !l->movetime_ms)
+            l->movetime_ms = MATCH_DEFAULT_MOVETIME;
+    }
+    int workers = run.concurrency < 1 ? 1 : run.concurrency > MAX_THREADS ? MAX_THREADS : run.concurrency;
+    st.cfg = &run;
+    pthread_mutex_init(&st.lock, NULL);
+    search_init();
+
+    printf("Match: %d games, %d at a time, %d opening%s, SPRT elo0 %.1f elo1 %.1f alpha %.2f beta %.2f\n",
+           run.games, workers, st.n_openings, st.n_openings == 1 ? "" : "s", run.elo0, run.elo1, run.alpha, run.beta);
+    st.start_ms = now_ms();
+    pthread_t handles[MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < workers; i++)
+    {
+        if (pthread_create(&handles[started], NULL, match_worker, &st) != 0)
+            break;
+        started++;
+    }
+    match_worker(&st);
+    for (int i = 0; i < started; i++)
+        pthread_join(handles[i], NULL);
+
+    printf("\nFinal after %d games in %lld s:\n", st.wins + st.draws + st.losses, (now_ms() - st.start_ms) / 1000);
+    if (st.wins + st.draws + st.losses)
+        report_stats(&st);
+    pthread_mutex_destroy(&st.lock);
+    free(st.openings);
+    return 1;
+}
+
+// Engine settings: a.NAME VALUE or b.NAME VALUE, or both.NAME VALUE
+static int set_engine_option(EngineConfig *e, const char *name, const char *value)
+{
+    int n = atoi(value);
+    if (strcmp(name, "depth") == 0)
+        e->limits.depth = n;
+    else if (strcmp(name, "movetime") == 0)
+        e->limits.movetime_ms = atoll(value);
+    else if (strcmp(name, "nodes") == 0)
+        e->limits.nodes = strtoull(value, NULL, 10);
+    else if (strcmp(name, "threads") == 0)
+        e->threads = n;
+    else if (strcmp(name, "hash") == 0)
+        e->hash_mb = n > 0 ? (size_t)n : 1;
+    else if (strcmp(name, "nullmove") == 0)
+        e->options.null_move = n;
+    else if (strcmp(name, "lmr") == 0)
+        e->options.lmr = n;
+    else if (strcmp(name, "aspiration") == 0)
+        e->options.aspiration = n;
+    else if (strcmp(name, "tables") == 0)
+        e->options.endgame_tables = n;
+    else if (strcmp(name, "contempt") == 0)
+        e->options.contempt = n;
+    else
+        return 0;
+    return 1;
+}
+
+// chess match [games N] [concurrency N] [openings FILE] [resign CP MOVES] [draw CP MOVES PLY]
+//             [maxplies N] [sprt ELO0 ELO1 ALPHA BETA] [syzygy DIRS] [bitbases FILE]
+//             [a.|b.|both.]depth|movetime|nodes|threads|hash|nullmove|lmr|aspiration|tables|
+//             contempt VALUE ...
+// The endgame tables are loaded once for both engines; "tables" decides which of them probe.
+int match_command(int argc, char **argv)
+{
+    MatchConfig cfg;
+    match_default_config(&cfg);
+    const char *syzygy = NULL, *bitbases = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        int left = argc - i - 1;
+        if (strcmp(arg, "games") == 0 && left >= 1)
+            cfg.games = atoi(argv[++i]);
+        else if (strcmp(arg, "concurrency") == 0 && left >= 1)
+            cfg.concurrency = atoi(argv[++i]);
+        else if (strcmp(arg, "openings") == 0 && left >= 1)
+            cfg.openings = argv[++i];
+        else if (strcmp(arg, "resign") == 0 && left >= 2)
+        {
+            cfg.resign_score = atoi(argv[++i]);
+            cfg.resign_moves = atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "draw") == 0 && left >= 3)
+        {
+            cfg.draw_score = atoi(argv[++i]);
+            cfg.draw_moves = atoi(argv[++i]);
+            cfg.draw_min_ply = atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "maxplies") == 0 && left >= 1)
+            cfg.max_plies = atoi(argv[++i]);
+        else if (strcmp(arg, "sprt") == 0 && left >= 4)
+        {
+            cfg.elo0 = atof(argv[++i]);
+            cfg.elo1 = atof(argv[++i]);
+            cfg.alpha = atof(argv[++i]);
+            cfg.beta = atof(argv[++i]);
+        }
+        else if (strcmp(arg, "syzygy") == 0 && left >= 1)
+            syzygy = argv[++i];
+        else if (strcmp(arg, "bitbases") == 0 && left >= 1)
+            bitbases = argv[++i];
+        else if (left >= 1 && (strncmp(arg, "a.", 2) == 0 || strncmp(arg, "b.", 2) == 0 || strncmp(arg, "both.", 5) == 0))
+        {
+            const char *name = strchr(arg, '.') + 1;
+            const char *value = argv[++i];
+            int ok = 1;
+            if (arg[0] != 'b' || arg[1] == 'o')
+                ok &= set_engine_option(&cfg.engine[0], name, value);
+            if (arg[0] == 'b')
+                ok &= set_engine_option(&cfg.engine[1], name, value);
+            if (!ok)
+            {
+                printf("Unknown engine setting %s\n", arg);
+                return 1;
+            }
+        }
+        else
+        {
+            printf("usage: match [games N] [concurrency N] [openings FILE] [resign CP MOVES] [draw CP MOVES PLY]\n"
+                   "             [maxplies N] [sprt ELO0 ELO1 ALPHA BETA] [syzygy DIRS] [bitbases FILE]\n"
+                   "             [a.|b.|both.]depth|movetime|nodes|threads|hash|nullmove|lmr|aspiration|tables|contempt VALUE\n");
+            return 1;
+        }
+    }
+    if (cfg.games < 1 || cfg.alpha <= 0.0 || cfg.beta <= 0.0 || cfg.alpha >= 1.0 || cfg.beta >= 1.0)
+    {
+        printf("Invalid match settings\n");
+        return 1;
+    }
+    if (syzygy && !tb_init(syzygy))
+    {
+        printf("No tablebases found in %s\n", syzygy);
+        return 1;
+    }
+    if (bitbases && !bitbase_open(bitbases))
+    {
+        printf("Cannot open bitbases %s, build them with: chess bitbases %s\n", bitbases, bitbases);
+        return 1;
+    }
+    return match_run(&cfg) ? 0 : 1;
+}
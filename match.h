@@ -0,0 +1,36 @@
+#ifndef MATCH_H
+#define MATCH_H
+#include "ai.h"
+
+// Self-play matches between two engine configurations, played in process on a pool of
+// workers, with Elo and SPRT statistics for engine A against engine B
+
+typedef struct
+{
+    SearchLimits limits; // per move; none at all = 100 ms
+    int threads;
+    size_t hash_mb;      // private transposition table, cleared before every game
+    SearchOptions options;
+} EngineConfig;
+
+typedef struct
+{
+    EngineConfig engine[2]; // A and B
+    int games;              // rounded up to whole pairs: every opening is played with both colors
+    int concurrency;        // games at once
+    const char *openings;   // EPD/FEN lines or a .pgn file; NULL = the start position
+    int resign_score;       // adjudicate a win once both engines see at least this (0 = off)...
+    int resign_moves;       // ...for this many moves each
+    int draw_score;         // adjudicate a draw once both engines see at most this...
+    int draw_moves;         // ...for this many moves each (0 = off)...
+    int draw_min_ply;       // ...from this ply on
+    int max_plies;          // draw the game after this many plies (0 = no limit)
+    double elo0, elo1;      // SPRT hypotheses H0: elo = elo0, H1: elo = elo1
+    double alpha, beta;     // SPRT error rates
+} MatchConfig;
+
+void match_default_config(MatchConfig *cfg);
+int match_run(const MatchConfig *cfg);
+int match_command(int argc, char **argv);
+
+#endif
\ No newline at end of file
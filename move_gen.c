@@ -1,5 +1,295 @@
 #include "move_gen.h"
 
+enum
+{
+    DIR_N,
+    DIR_S,
+    DIR_E,
+    DIR_W,
+    DIR_NE,
+    DIR_NW,
+    DIR_SE,
+    DIR_SW
+};
+
+// Shift every square of a set one step in a direction, dropping squares that leave the board
+static inline Bitboard shift_dir(Bitboard b, int dir)
+{
+    switch (dir)
+    {
+    case DIR_N:
+        return b >> 8;
+    case DIR_S:
+        return b << 8;
+    case DIR_E:
+        return (b << 1) & ~FILE_A;
+    case DIR_W:
+        return (b >> 1) & ~FILE_H;
+    case DIR_NE:
+        return (b >> 7) & ~FILE_A;
+    case DIR_NW:
+        return (b >> 9) & ~FILE_H;
+    case DIR_SE:
+        return (b << 9) & ~FILE_A;
+    case DIR_SW:
+        return (b << 7) & ~FILE_H;
+    }
+    return 0;
+}
+
+// Flood along one direction through empty squares; the first blocker is included
+static inline Bitboard slide_fill(Bitboard gen, Bitboard empty, int dir)
+{
+    Bitboard flood = gen;
+    while ((gen = shift_dir(gen, dir) & empty))
+        flood |= gen;
+    return shift_dir(flood, dir);
+}
+
+Bitboard pawn_attacks_bb(Bitboard pawns, int color)
+{
+    if (color == WHITE)
+        return shift_dir(pawns, DIR_NE) | shift_dir(pawns, DIR_NW);
+    return shift_dir(pawns, DIR_SE) | shift_dir(pawns, DIR_SW);
+}
+
+Bitboard knight_attacks_bb(Bitboard knights)
+{
+    Bitboard e1 = (knights << 1) & ~FILE_A;
+    Bitboard w1 = (knights >> 1) & ~FILE_H;
+    Bitboard e2 = (knights << 2) & ~(FILE_A | FILE_B);
+    Bitboard w2 = (knights >> 2) & ~(FILE_G | FILE_H);
+    Bitboard h1 = e1 | w1, h2 = e2 | w2;
+    return (h1 << 16) | (h1 >> 16) | (h2 << 8) | (h2 >> 8);
+}
+
+Bitboard king_attacks_bb(Bitboard kings)
+{
+    Bitboard row = kings | shift_dir(kings, DIR_E) | shift_dir(kings, DIR_W);
+    return (row | (row << 8) | (row >> 8)) & ~kings;
+}
+
+Bitboard bishop_attacks_bb(Bitboard bishops, Bitboard occupied)
+{
+    Bitboard empty = ~occupied;
+    return slide_fill(bishops, empty, DIR_NE) | slide_fill(bishops, empty, DIR_NW) |
+           slide_fill(bishops, empty, DIR_SE) | slide_fill(bishops, empty, DIR_SW);
+}
+
+Bitboard rook_attacks_bb(Bitboard rooks, Bitboard occupied)
+{
+    Bitboard empty = ~occupied;
+    return slide_fill(rooks, empty, DIR_N) | slide_fill(rooks, empty, DIR_S) |
+           slide_fill(rooks, empty, DIR_E) | slide_fill(rooks, empty, DIR_W);
+}
+
+Bitboard pawn_attacks[2][64];
+Bitboard knight_attacks[64];
+Bitboard king_attacks[64];
+SliderMagic bishop_magics[64];
+SliderMagic rook_magics[64];
+static Bitboard slider_table[0x19000 + 0x1480]; // rook slices (102400) then bishop slices (5248)
+static Bitboard between_table[64][64];
+
+// Magic multipliers found by init_slider's search (seed 0x5EED) and kept so that startup
+// only has to verify them
+static const Bitboard rook_magic_seeds[64] = {
+    0x0080018840015420ULL, 0x0540100420014002ULL, 0x0100110008402004ULL, 0x0900100100200408ULL,
+    0x2A00200200080410ULL, 0x6080040002008001ULL, 0x4280020000800100ULL, 0x0180004100002480ULL,
+    0x0020800232400280ULL, 0x0189402010004001ULL, 0x0008802000801008ULL, 0x8082001008204204ULL,
+    0x0022000A00201004ULL, 0x0804802400020080ULL, 0x2114001001080204ULL, 0x0001800500004080ULL,
+    0x8040208000400080ULL, 0x4110820022420300ULL, 0x0000808010002002ULL, 0x0000090010002100ULL,
+    0x0000808004000802ULL, 0x0002008002040080ULL, 0x08E0040001100208ULL, 0x8288060000A24C03ULL,
+    0x8800802080004000ULL, 0x8090500040002000ULL, 0x9020010100104020ULL, 0x200A001200200840ULL,
+    0x020C000808004080ULL, 0x0002000200100804ULL, 0x0001002100141200ULL, 0x0080014200209904ULL,
+    0x0080814001800024ULL, 0x8410002000404002ULL, 0x0220A00082803000ULL, 0x0000080080801000ULL,
+    0x8404008008080040ULL, 0x4006000402000810ULL, 0x0801020804005001ULL, 0x4400800040800100ULL,
+    0x044018C221808000ULL, 0x1021500320044000ULL, 0x3006048020120041ULL, 0x1270008008008010ULL,
+    0x2054000800808004ULL, 0x40C1000804010002ULL, 0x05800208410400B0ULL, 0x0640508061160004ULL,
+    0x202040118000A280ULL, 0x0020084008802080ULL, 0x0008204080120200ULL, 0x4101A30210000900ULL,
+    0x090500C800045100ULL, 0x000200E4000E8080ULL, 0x0030500102884400ULL, 0x1900404401008200ULL,
+    0x8010800010204109ULL, 0x2020108900244001ULL, 0x9000084011002001ULL, 0x1042442100C81001ULL,
+    0x1409000210040801ULL, 0x0112000811041016ULL, 0x197A100802008104ULL, 0x0928840102815422ULL};
+static const Bitboard bishop_magic_seeds[64] = {
+    0x0440100200803280ULL, 0x4250100900618808ULL, 0x2004010425084090ULL, 0x840C042580A00001ULL,
+    0x0014242000800002ULL, 0x0042086208000288ULL, 0x0080420820088040ULL, 0x8029010810840402ULL,
+    0x4020040410040108ULL, 0x0020840404040832ULL, 0x8C201044004040A8ULL, 0x8000040418800204ULL,
+    0x4110C11041182050ULL, 0xC881010120100000ULL, 0x9210020202218401ULL, 0x4300048401080201ULL,
+    0x5140002104240080ULL, 0xC104001050009100ULL, 0x80900C8A44048220ULL, 0x0208000C02400A04ULL,
+    0x0284002A0611100DULL, 0x4001000480A0010AULL, 0x8004100C80841049ULL, 0x0000400208420800ULL,
+    0x2020100020024220ULL, 0x02080400A9210815ULL, 0x0000500008008012ULL, 0x7034080020220040ULL,
+    0x00490010A5004000ULL, 0x0000920001010080ULL, 0x020A285028841000ULL, 0x0001120003420089ULL,
+    0x9044022001424410ULL, 0x100110820008880CULL, 0x1021004046080080ULL, 0x2200020080480082ULL,
+    0x2004140400001010ULL, 0x2000900102038084ULL, 0x0021190204040240ULL, 0x0004244200614120ULL,
+    0x02008248401C2000ULL, 0x8005010820810280ULL, 0x0030202030002800ULL, 0x0000020102412403ULL,
+    0x4100080104442400ULL, 0x000AAE1042000100ULL, 0x1002108111008200ULL, 0x0008420040400200ULL,
+    0x4086023005040004ULL, 0x0012841111100200ULL, 0x240004242208270AULL, 0x000C081104980400ULL,
+    0x0020A00410440000ULL, 0x1800430408098400ULL, 0x2020C40102240000ULL, 0x00788200DC01000AULL,
+    0x1100105110082000ULL, 0x0600004420A80808ULL, 0x00018003004110A4ULL, 0x1010700000208830ULL,
+    0x0801102091020200ULL, 0x4000000408105100ULL, 0x8000300401481620ULL, 0x1010042810404200ULL};
+
+// Sparse random candidates (few set bits) make good magics
+static uint64_t magic_rand(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Fill one square's slice: enumerate every subset of the mask (carry-rippler), work out
+// its attacks with the ray-walking generator, then index them with a collision-free magic.
+// The stored magic is tried first; a random search takes over only if it does not fit.
+static Bitboard *init_slider(SliderMagic *m, int sq, Bitboard *table, Bitboard (*slow)(Bitboard, Bitboard),
+                             Bitboard known, uint64_t *seed)
+{
+    static Bitboard occupancy[4096], reference[4096];
+    static int epoch[4096];
+    Bitboard edges = ((RANK_1 | RANK_8) & ~(RANK_8 << (8 * SQ_X(sq)))) | ((FILE_A | FILE_H) & ~(FILE_A << SQ_Y(sq)));
+    m->mask = slow(BIT(sq), 0) & ~edges;
+    m->shift = 64 - popcount(m->mask);
+    m->attacks = table;
+
+    int size = 0;
+    Bitboard subset = 0;
+    do
+    {
+        occupancy[size] = subset;
+        reference[size++] = slow(BIT(sq), subset);
+        subset = (subset - m->mask) & m->mask;
+    } while (subset);
+
+#if defined(USE_PEXT) && defined(__BMI2__)
+    (void)known;
+    (void)seed;
+    (void)epoch;
+    (void)magic_rand;
+    m->magic = 0;
+    for (int i = 0; i < size; i++)
+        table[slider_index(m, occupancy[i])] = reference[i];
+#else
+    static int attempt = 0;
+    int tries = 0;
+    m->magic = known;
+    for (int i = 0; i < size;)
+    {
+        if (tries++ > 0 || !m->magic)
+        {
+            do
+                m->magic = magic_rand(seed) & magic_rand(seed) & magic_rand(seed);
+            while (popcount((m->mask * m->magic) >> 56) < 6);
+        }
+
+        // Entries stamped with an older attempt count as empty
+        attempt++;
+        for (i = 0; i < size; i++)
+        {
+            unsigned idx = slider_index(m, occupancy[i]);
+            if (epoch[idx] < attempt)
+            {
+                epoch[idx] = attempt;
+                table[idx] = reference[i];
+            }
+            else if (table[idx] != reference[i])
+                break;
+        }
+    }
+#endif
+    return table + size;
+}
+
+void attacks_init(void)
+{
+    static int done = 0;
+    if (done)
+        return;
+    for (int sq = 0; sq < 64; sq++)
+    {
+        pawn_attacks[WHITE][sq] = pawn_attacks_bb(BIT(sq), WHITE);
+        pawn_attacks[BLACK][sq] = pawn_attacks_bb(BIT(sq), BLACK);
+        knight_attacks[sq] = knight_attacks_bb(BIT(sq));
+        king_attacks[sq] = king_attacks_bb(BIT(sq));
+    }
+
+    uint64_t seed = 0x5EED;
+    Bitboard *next = slider_table;
+    for (int sq = 0; sq < 64; sq++)
+        next = init_slider(&rook_magics[sq], sq, next, rook_attacks_bb, rook_magic_seeds[sq], &seed);
+    for (int sq = 0; sq < 64; sq++)
+        next = init_slider(&bishop_magics[sq], sq, next, bishop_attacks_bb, bishop_magic_seeds[sq], &seed);
+
+    for (int a = 0; a < 64; a++)
+    {
+        for (int b = 0; b < 64; b++)
+        {
+            int ax = SQ_X(a), ay = SQ_Y(a), bx = SQ_X(b), by = SQ_Y(b);
+            Bitboard line = 0;
+            if (a == b)
+                line = 0;
+            else if (ax == bx || ay == by)
+                line = rook_attacks_from(a, BIT(b)) & rook_attacks_from(b, BIT(a));
+            else if (ax - ay == bx - by || ax + ay == bx + by)
+                line = bishop_attacks_from(a, BIT(b)) & bishop_attacks_from(b, BIT(a));
+            between_table[a][b] = line;
+        }
+    }
+    done = 1;
+}
+
+Bitboard attacked_squares(Board *b, int color)
+{
+    return attacks_by(b, color, board_occupied(b));
+}
+
+// Everything `color` attacks if the board had the given occupancy
+Bitboard attacks_by(Board *b, int color, Bitboard occ)
+{
+    Bitboard own = b->colors[color];
+    Bitboard diag = (b->pieces[BISHOP] | b->pieces[QUEEN]) & own;
+    Bitboard orth = (b->pieces[ROOK] | b->pieces[QUEEN]) & own;
+    Bitboard att = pawn_attacks_bb(b->pieces[PAWN] & own, color) | knight_attacks_bb(b->pieces[KNIGHT] & own);
+    if (b->king_sq[color] != NO_SQUARE)
+        att |= king_attacks[b->king_sq[color]];
+    while (diag)
+        att |= bishop_attacks_from(pop_lsb(&diag), occ);
+    while (orth)
+        att |= rook_attacks_from(pop_lsb(&orth), occ);
+    return att;
+}
+
+// Every piece (both colors) attacking `sq`, given an occupancy
+Bitboard attackers_to(Board *b, int sq, Bitboard occupied)
+{
+    Bitboard diag = b->pieces[BISHOP] | b->pieces[QUEEN];
+    Bitboard orth = b->pieces[ROOK] | b->pieces[QUEEN];
+    return (pawn_attacks[BLACK][sq] & b->pieces[PAWN] & b->colors[WHITE]) |
+           (pawn_attacks[WHITE][sq] & b->pieces[PAWN] & b->colors[BLACK]) |
+           (knight_attacks[sq] & b->pieces[KNIGHT]) |
+           (king_attacks[sq] & b->pieces[KING]) |
+           (bishop_attacks_from(sq, occupied) & diag) |
+           (rook_attacks_from(sq, occupied) & orth);
+}
+
+// Look outward from `sq` along pawn, knight, king and slider lines for a `by_color` attacker
+int is_square_attacked(Board *b, int sq, int by_color)
+{
+    Bitboard them = b->colors[by_color];
+    if (pawn_attacks[!by_color][sq] & b->pieces[PAWN] & them)
+        return 1;
+    if (knight_attacks[sq] & b->pieces[KNIGHT] & them)
+        return 1;
+    if (king_attacks[sq] & b->pieces[KING] & them)
+        return 1;
+    Bitboard occ = board_occupied(b);
+    Bitboard diag = (b->pieces[BISHOP] | b->pieces[QUEEN]) & them;
+    if (diag && (bishop_attacks_from(sq, occ) & diag))
+        return 1;
+    Bitboard orth = (b->pieces[ROOK] | b->pieces[QUEEN]) & them;
+    if (orth && (rook_attacks_from(sq, occ) & orth))
+        return 1;
+    return 0;
+}
+
 void append_pos(Pos *out, int *n, int x, int y)
 {
     if (x >= 0 && x < 8 && y >= 0 && y < 8)
@@ -10,166 +300,241 @@ void append_pos(Pos *out, int *n, int x, int y)
     }
 }
 
-void get_available_moves(Board *b, int x, int y, int include_castling, Pos *out, int *out_count)
+// Pseudo-legal destination set of the piece on `sq`
+Bitboard get_move_targets(Board *b, int sq, int include_castling)
 {
-    *out_count = 0;
-    Cell c = b->cells[x][y];
-    char color = c.state;
-    char piece = c.piece;
-    if (piece == 0 || color == 'E')
-        return;
+    int piece = b->squares[sq];
+    if (piece == NO_PIECE)
+        return 0;
+    int color = piece_color(piece);
+    Bitboard own = b->colors[color];
+    Bitboard occ = board_occupied(b);
+    Bitboard from = BIT(sq);
 
-    if (piece == 'P')
+    switch (piece_type(piece))
+    {
+    case PAWN:
     {
-        if (color == 'W')
+        Bitboard push;
+        if (color == WHITE)
         {
-            if (x > 0 && b->cells[x - 1][y].state == 'E')
-                append_pos(out, out_count, x - 1, y);
-            if (x == 6 && b->cells[x - 2][y].state == 'E' && b->cells[x - 1][y].state == 'E')
-                append_pos(out, out_count, x - 2, y);
-            if (x > 0 && y > 0 && b->cells[x - 1][y - 1].state == 'B')
-                append_pos(out, out_count, x - 1, y - 1);
-            if (x > 0 && y < 7 && b->cells[x - 1][y + 1].state == 'B')
-                append_pos(out, out_count, x - 1, y + 1);
+            push = (from >> 8) & ~occ;
+            if (push && SQ_X(sq) == 6)
+                push |= (push >> 8) & ~occ;
         }
         else
         {
-            if (x < 7 && b->cells[x + 1][y].state == 'E')
-                append_pos(out, out_count, x + 1, y);
-            if (x == 1 && b->cells[x + 2][y].state == 'E' && b->cells[x + 1][y].state == 'E')
-                append_pos(out, out_count, x + 2, y);
-            if (x < 7 && y > 0 && b->cells[x + 1][y - 1].state == 'W')
-                append_pos(out, out_count, x + 1, y - 1);
-            if (x < 7 && y < 7 && b->cells[x + 1][y + 1].state == 'W')
-                append_pos(out, out_count, x + 1, y + 1);
+            push = (from << 8) & ~occ;
+            if (push && SQ_X(sq) == 1)
+                push |= (push << 8) & ~occ;
         }
-        return;
+        Bitboard victims = b->colors[!color];
+        if (b->ep_square != NO_SQUARE)
+            victims |= BIT(b->ep_square);
+        return push | (pawn_attacks[color][sq] & victims);
     }
-
-    if (piece == 'R' || piece == 'Q')
+    case KNIGHT:
+        return knight_attacks[sq] & ~own;
+    case BISHOP:
+        return bishop_attacks_from(sq, occ) & ~own;
+    case ROOK:
+        return rook_attacks_from(sq, occ) & ~own;
+    case QUEEN:
+        return queen_attacks_from(sq, occ) & ~own;
+    case KING:
     {
-        int dirs[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
-        for (int d = 0; d < 4; d++)
+        Bitboard targets = king_attacks[sq] & ~own;
+        if (include_castling)
         {
-            int dx = dirs[d][0], dy = dirs[d][1];
-            int nx = x + dx, ny = y + dy;
-            while (nx >= 0 && nx < 8 && ny >= 0 && ny < 8)
-            {
-                if (b->cells[nx][ny].state == 'E')
-                {
-                    append_pos(out, out_count, nx, ny);
-                }
-                else if (b->cells[nx][ny].state != color)
-                {
-                    append_pos(out, out_count, nx, ny);
-                    break;
-                }
-                else
-                    break;
-                nx += dx;
-                ny += dy;
-            }
+            char c = color_char(color);
+            if (board_can_castle(b, c, 'K'))
+                targets |= BIT(sq + 2);
+            if (board_can_castle(b, c, 'Q'))
+                targets |= BIT(sq - 2);
         }
-        if (piece == 'R')
-            goto maybe_castle;
+        return targets;
+    }
+    }
+    return 0;
+}
+
+void get_available_moves(Board *b, int x, int y, int include_castling, Pos *out, int *out_count)
+{
+    *out_count = 0;
+    Bitboard targets = get_move_targets(b, SQ(x, y), include_castling);
+    while (targets)
+    {
+        int to = pop_lsb(&targets);
+        append_pos(out, out_count, SQ_X(to), SQ_Y(to));
+    }
+}
+
+// Squares strictly between two squares on a shared rank, file or diagonal (0 otherwise)
+Bitboard between_bb(int a, int b)
+{
+    return between_table[a][b];
+}
+
+// Checkers, pins and king-safe squares for `color`, computed once per position
+void compute_legal_mask(Board *b, int color, LegalMask *m)
+{
+    int ksq = b->king_sq[color];
+    m->pinned = 0;
+    m->checkers = 0;
+    m->check_mask = ~0ULL;
+    m->king_safe = ~0ULL;
+    if (ksq == NO_SQUARE)
+        return;
+
+    Bitboard occ = board_occupied(b);
+    Bitboard own = b->colors[color], them = b->colors[!color];
+    Bitboard diag = (b->pieces[BISHOP] | b->pieces[QUEEN]) & them;
+    Bitboard orth = (b->pieces[ROOK] | b->pieces[QUEEN]) & them;
+
+    m->checkers = attackers_to(b, ksq, occ) & them;
+    if (m->checkers)
+    {
+        if (m->checkers & (m->checkers - 1))
+            m->check_mask = 0; // double check: only the king may move
+        else
+            m->check_mask = m->checkers | between_bb(ksq, lsb(m->checkers));
     }
 
-    if (piece == 'B' || piece == 'Q')
+    // Enemy sliders that would see the king through our pieces
+    Bitboard snipers = (rook_attacks_from(ksq, them) & orth) | (bishop_attacks_from(ksq, them) & diag);
+    while (snipers)
     {
-        int dirs[4][2] = {{-1, -1}, {-1, 1}, {1, -1}, {1, 1}};
-        for (int d = 0; d < 4; d++)
+        int s = pop_lsb(&snipers);
+        Bitboard line = between_bb(ksq, s);
+        Bitboard blockers = line & occ;
+        if (blockers && !(blockers & (blockers - 1)) && (blockers & own))
         {
-            int dx = dirs[d][0], dy = dirs[d][1];
-            int nx = x + dx, ny = y + dy;
-            while (nx >= 0 && nx < 8 && ny >= 0 && ny < 8)
-            {
-                if (b->cells[nx][ny].state == 'E')
-                {
-                    append_pos(out, out_count, nx, ny);
-                }
-                else if (b->cells[nx][ny].state != color)
-                {
-                    append_pos(out, out_count, nx, ny);
-                    break;
-                }
-                else
-                    break;
-                nx += dx;
-                ny += dy;
-            }
+            m->pinned |= blockers;
+            m->pin_ray[lsb(blockers)] = line | BIT(s);
         }
-        if (piece == 'B')
-            goto done_piece;
     }
 
-    if (piece == 'N')
+    // Lift the king so it cannot hide behind itself along a checking line
+    m->king_safe = ~attacks_by(b, !color, occ ^ BIT(ksq));
+}
+
+// En passant removes two pawns from one rank, so pins alone cannot decide it:
+// replay the occupancy change and look for a slider that now sees the king.
+static int ep_capture_is_legal(Board *b, int from, int color, const LegalMask *m)
+{
+    int ep = b->ep_square;
+    int captured = ep + (color == WHITE ? 8 : -8);
+    if (!(m->check_mask & (BIT(ep) | BIT(captured))))
+        return 0;
+    int ksq = b->king_sq[color];
+    if (ksq == NO_SQUARE)
+        return 1;
+    Bitboard occ = (board_occupied(b) ^ BIT(from) ^ BIT(captured)) | BIT(ep);
+    Bitboard them = b->colors[!color];
+    Bitboard diag = (b->pieces[BISHOP] | b->pieces[QUEEN]) & them;
+    Bitboard orth = (b->pieces[ROOK] | b->pieces[QUEEN]) & them;
+    return !((bishop_attacks_from(ksq, occ) & diag) | (rook_attacks_from(ksq, occ) & orth));
+}
+
+// Legal destinations of the piece on `sq` under a precomputed mask
+Bitboard legal_targets(Board *b, int sq, const LegalMask *m, int include_castling)
+{
+    Bitboard targets = get_move_targets(b, sq, 0);
+    int color = piece_color(b->squares[sq]);
+    if (sq == b->king_sq[color])
     {
-        int jumps[8][2] = {{2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}};
-        for (int k = 0; k < 8; k++)
+        targets &= m->king_safe;
+        if (include_castling && !m->checkers)
         {
-            int nx = x + jumps[k][0], ny = y + jumps[k][1];
-            if (nx >= 0 && nx < 8 && ny >= 0 && ny < 8)
-            {
-                char st = b->cells[nx][ny].state;
-                if (st == 'E' || st != color)
-                    append_pos(out, out_count, nx, ny);
-            }
+            char c = color_char(color);
+            if (board_can_castle(b, c, 'K'))
+                targets |= BIT(sq + 2);
+            if (board_can_castle(b, c, 'Q'))
+                targets |= BIT(sq - 2);
         }
-        goto done_piece;
+        return targets;
     }
+    Bitboard ep = 0;
+    if (b->ep_square != NO_SQUARE && piece_type(b->squares[sq]) == PAWN)
+        ep = targets & BIT(b->ep_square);
+    targets &= m->check_mask;
+    if (m->pinned & BIT(sq))
+        targets &= m->pin_ray[sq];
+    if (ep && !ep_capture_is_legal(b, sq, color, m))
+        targets &= ~ep;
+    else
+        targets |= ep;
+    return targets;
+}
 
-    if (piece == 'K')
+// Emit every legal move of `color` whose destination lies in `target_filter`
+// (`pawn_filter` for pawns, so en passant can be told apart from a quiet move to that square)
+static void emit_moves(Board *b, int color, const LegalMask *m, Bitboard target_filter, Bitboard pawn_filter,
+                       int include_castling, Move *out, int *out_n)
+{
+    *out_n = 0;
+
+    Bitboard movers = b->colors[color];
+    if (m->check_mask == 0)
+        movers &= b->pieces[KING];
+    while (movers)
     {
-        for (int dx = -1; dx <= 1; dx++)
+        int from = pop_lsb(&movers);
+        int promoting = piece_type(b->squares[from]) == PAWN;
+        Bitboard targets = legal_targets(b, from, m, include_castling) & (promoting ? pawn_filter : target_filter);
+        while (targets)
         {
-            for (int dy = -1; dy <= 1; dy++)
+            int to = pop_lsb(&targets);
+            if (promoting && (BIT(to) & (RANK_1 | RANK_8)))
             {
-                if (dx == 0 && dy == 0)
-                    continue;
-                int nx = x + dx, ny = y + dy;
-                if (nx >= 0 && nx < 8 && ny >= 0 && ny < 8)
-                {
-                    char st = b->cells[nx][ny].state;
-                    if (st == 'E' || st != color)
-                        append_pos(out, out_count, nx, ny);
-                }
+                static const char promos[4] = {'Q', 'R', 'B', 'N'};
+                for (int k = 0; k < 4; k++)
+                    out[(*out_n)++] = (Move){.from_x = SQ_X(from), .from_y = SQ_Y(from), .to_x = SQ_X(to), .to_y = SQ_Y(to), .promo = promos[k]};
+                continue;
             }
-        }
-    maybe_castle:
-        if (include_castling)
-        {
-            if (board_can_castle(b, color, 'K'))
-                append_pos(out, out_count, x, y + 2);
-            if (board_can_castle(b, color, 'Q'))
-                append_pos(out, out_count, x, y - 2);
+            out[*out_n] = (Move){.from_x = SQ_X(from), .from_y = SQ_Y(from), .to_x = SQ_X(to), .to_y = SQ_Y(to)};
+            (*out_n)++;
         }
     }
-
-done_piece:
-    return;
 }
 
-void filter_legal_moves(Board *b, int x, int y, Pos *moves, int moves_count, char color, Pos *out, int *out_count)
+// Every legal move of `color` landing in `target_filter`
+void generate_legal_moves(Board *b, int color, Bitboard target_filter, int include_castling, Move *out, int *out_n)
 {
-    *out_count = 0;
-    for (int i = 0; i < moves_count; i++)
-    {
-        int nx = moves[i].x, ny = moves[i].y;
-        Cell saved_from = b->cells[x][y];
-        Cell saved_to = b->cells[nx][ny];
-
-        b->cells[nx][ny] = saved_from;
-        b->cells[x][y] = (Cell){'E', 0};
+    LegalMask m;
+    compute_legal_mask(b, color, &m);
+    emit_moves(b, color, &m, target_filter, target_filter, include_castling, out, out_n);
+}
 
-        int ok = !board_is_in_check(b, color);
+// Captures, en passant included; `m` must be compute_legal_mask(b, color)
+void generate_captures(Board *b, int color, const LegalMask *m, Move *out, int *out_n)
+{
+    Bitboard enemies = b->colors[!color];
+    Bitboard ep = b->ep_square != NO_SQUARE ? BIT(b->ep_square) : 0;
+    emit_moves(b, color, m, enemies, enemies | ep, 0, out, out_n);
+}
 
-        b->cells[x][y] = saved_from;
-        b->cells[nx][ny] = saved_to;
+// Everything generate_captures leaves out: quiet moves, quiet promotions and castling
+void generate_quiets(Board *b, int color, const LegalMask *m, Move *out, int *out_n)
+{
+    Bitboard empty = ~board_occupied(b);
+    Bitboard ep = b->ep_square != NO_SQUARE ? BIT(b->ep_square) : 0;
+    emit_moves(b, color, m, empty, empty & ~ep, 1, out, out_n);
+}
 
-        if (ok)
-        {
-            out[*out_count] = (Pos){nx, ny};
-            (*out_count)++;
-        }
+// Per-piece query used by the CLI to highlight destinations
+void get_legal_moves(Board *b, int x, int y, Pos *out, int *out_count)
+{
+    *out_count = 0;
+    int sq = SQ(x, y);
+    if (b->squares[sq] == NO_PIECE)
+        return;
+    LegalMask m;
+    compute_legal_mask(b, piece_color(b->squares[sq]), &m);
+    Bitboard targets = legal_targets(b, sq, &m, 1);
+    while (targets)
+    {
+        int to = pop_lsb(&targets);
+        append_pos(out, out_count, SQ_X(to), SQ_Y(to));
     }
 }
@@ -2,9 +2,93 @@
 #define MOVE_GEN_H
 #include "board.h"
 
+#define FILE_A 0x0101010101010101ULL
+#define FILE_B 0x0202020202020202ULL
+#define FILE_G 0x4040404040404040ULL
+#define FILE_H 0x8080808080808080ULL
+#define RANK_8 0x00000000000000FFULL
+#define RANK_1 0xFF00000000000000ULL
+
+#if defined(USE_PEXT) && defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+// Set-wise attack generators: every square attacked by any piece in `from`
+Bitboard pawn_attacks_bb(Bitboard pawns, int color);
+Bitboard knight_attacks_bb(Bitboard knights);
+Bitboard king_attacks_bb(Bitboard kings);
+Bitboard bishop_attacks_bb(Bitboard bishops, Bitboard occupied);
+Bitboard rook_attacks_bb(Bitboard rooks, Bitboard occupied);
+
+// Per-square lookups, filled once by attacks_init() (board_init / board_set_fen call it).
+// Sliders use magic bitboards: the relevant blockers are hashed into a per-square slice of
+// one shared attack table. Built with -mbmi2 -DUSE_PEXT, the index is a PEXT instead.
+typedef struct
+{
+    Bitboard mask;     // squares whose occupancy matters: the rays minus the board edge
+    Bitboard magic;    // multiplier mapping each blocker subset to its own index
+    Bitboard *attacks; // this square's slice of the attack table
+    int shift;         // 64 - popcount(mask)
+} SliderMagic;
+
+extern Bitboard pawn_attacks[2][64];
+extern Bitboard knight_attacks[64];
+extern Bitboard king_attacks[64];
+extern SliderMagic bishop_magics[64];
+extern SliderMagic rook_magics[64];
+
+void attacks_init(void);
+
+static inline unsigned slider_index(const SliderMagic *m, Bitboard occupied)
+{
+#if defined(USE_PEXT) && defined(__BMI2__)
+    return (unsigned)_pext_u64(occupied, m->mask);
+#else
+    return (unsigned)(((occupied & m->mask) * m->magic) >> m->shift);
+#endif
+}
+
+static inline Bitboard bishop_attacks_from(int sq, Bitboard occupied)
+{
+    return bishop_magics[sq].attacks[slider_index(&bishop_magics[sq], occupied)];
+}
+
+static inline Bitboard rook_attacks_from(int sq, Bitboard occupied)
+{
+    return rook_magics[sq].attacks[slider_index(&rook_magics[sq], occupied)];
+}
+
+static inline Bitboard queen_attacks_from(int sq, Bitboard occupied)
+{
+    return bishop_attacks_from(sq, occupied) | rook_attacks_from(sq, occupied);
+}
+Bitboard attacked_squares(Board *b, int color);
+Bitboard attacks_by(Board *b, int color, Bitboard occupied);
+Bitboard between_bb(int a, int b);
+
+// Reverse lookups from a target square
+Bitboard attackers_to(Board *b, int sq, Bitboard occupied);
+int is_square_attacked(Board *b, int sq, int by_color);
+
+typedef struct
+{
+    Bitboard checkers;    // enemy pieces giving check
+    Bitboard check_mask;  // where non-king moves must land (all squares when not in check)
+    Bitboard pinned;      // our pieces pinned to the king
+    Bitboard king_safe;   // squares the king may step onto
+    Bitboard pin_ray[64]; // for each pinned square: the king-pinner line it may move along
+} LegalMask;
+
+Bitboard get_move_targets(Board *b, int sq, int include_castling);
+void compute_legal_mask(Board *b, int color, LegalMask *m);
+Bitboard legal_targets(Board *b, int sq, const LegalMask *m, int include_castling);
+void generate_legal_moves(Board *b, int color, Bitboard target_filter, int include_castling, Move *out, int *out_n);
+void generate_captures(Board *b, int color, const LegalMask *m, Move *out, int *out_n);
+void generate_quiets(Board *b, int color, const LegalMask *m, Move *out, int *out_n);
+
 void append_pos(Pos *out, int *n, int x, int y);
 void get_available_moves(Board *b, int x, int y, int include_castling, Pos *out, int *out_count);
-void filter_legal_moves(Board *b, int x, int y, Pos *moves, int moves_count, char color, Pos *out, int *out_count);
+void get_legal_moves(Board *b, int x, int y, Pos *out, int *out_count);
 
 
 #endif
\ No newline at end of file
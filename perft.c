@@ -0,0 +1,164 @@
+#include "perft.h"
+#include "ai.h"
+#include "util.h"
+
+// Standard reference positions with their published node counts (depth 1..n)
+typedef struct
+{
+    const char *name;
+    const char *fen;
+    uint64_t nodes[6];
+} PerftPosition;
+
+static const PerftPosition perft_positions[] = {
+    {"startpos", STARTPOS_FEN,
+     {20, 400, 8902, 197281, 4865609, 119060324}},
+    {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+     {48, 2039, 97862, 4085603, 193690690}},
+    {"position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+     {14, 191, 2812, 43238, 674624, 11030083}},
+    {"position 4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+     {6, 264, 9467, 422333, 15833292}},
+    {"position 4 mirrored", "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",
+     {6, 264, 9467, 422333, 15833292}},
+    {"position 5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+     {44, 1486, 62379, 2103487, 89941194}},
+    {"position 6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+     {46, 2079, 89890, 3894594, 164075551}},
+};
+
+// Leaf nodes of the legal move tree; the last ply is bulk-counted from the move list
+uint64_t perft(Board *b, int depth)
+{
+    Move moves[256];
+    int n = 0;
+    collect_legal_moves(b, color_char(b->side), moves, &n);
+    if (depth <= 1)
+        return depth == 1 ? (uint64_t)n : 1;
+
+    uint64_t nodes = 0;
+    for (int i = 0; i < n; i++)
+    {
+        Snapshot snap;
+        make_move(b, &moves[i], &snap);
+        nodes += perft(b, depth - 1);
+        undo_move(b, &moves[i], &snap);
+    }
+    return nodes;
+}
+
+static void report(uint64_t nodes, long long ms)
+{
+    double nps = ms > 0 ? (double)nodes * 1000.0 / (double)ms : 0.0;
+    printf("Nodes: %llu  Time: %lld ms  NPS: %.0f\n", (unsigned long long)nodes, ms, nps);
+}
+
+// Node count per root move, then the total
+uint64_t perft_divide(Board *b, int depth)
+{
+    Move moves[256];
+    int n = 0;
+    collect_legal_moves(b, color_char(b->side), moves, &n);
+
+    uint64_t total = 0;
+    long long start = now_ms();
+    for (int i = 0; i < n; i++)
+    {
+        Snapshot snap;
+        make_move(b, &moves[i], &snap);
+        uint64_t nodes = depth > 1 ? perft(b, depth - 1) : 1;
+        undo_move(b, &moves[i], &snap);
+
+        char name[6];
+        format_move(&moves[i], name);
+        printf("%s: %llu\n", name, (unsigned long long)nodes);
+        total += nodes;
+    }
+    printf("\nMoves: %d\n", n);
+    report(total, now_ms() - start);
+    return total;
+}
+
+// Run every reference position up to `max_depth`; returns the number of mismatches
+int perft_suite(int max_depth)
+{
+    static Board board;
+    int failures = 0;
+    uint64_t all_nodes = 0;
+    long long all_start = now_ms();
+
+    for (size_t p = 0; p < sizeof(perft_positions) / sizeof(perft_positions[0]); p++)
+    {
+        const PerftPosition *pos = &perft_positions[p];
+        board_set_fen(&board, pos->fen);
+        printf("%s\n  %s\n", pos->name, pos->fen);
+        for (int d = 1; d <= max_depth && d <= 6 && pos->nodes[d - 1]; d++)
+        {
+            long long start = now_ms();
+            uint64_t nodes = perft(&board, d);
+            long long ms = now_ms() - start;
+            int ok = nodes == pos->nodes[d - 1];
+            if (!ok)
+                failures++;
+            all_nodes += nodes;
+            printf("  depth %d: %12llu %s", d, (unsigned long long)nodes, ok ? "ok  " : "FAIL");
+            if (!ok)
+                printf(" (expected %llu)", (unsigned long long)pos->nodes[d - 1]);
+            printf("  %6lld ms  %10.0f nps\n", ms, ms > 0 ? (double)nodes * 1000.0 / (double)ms : 0.0);
+        }
+    }
+    printf("\n%s: ", failures ? "FAILED" : "All positions match");
+    report(all_nodes, now_ms() - all_start);
+    return failures;
+}
+
+// chess perft <depth> [fen]    total leaf count with throughput
+// chess divide <depth> [fen]   per-root-move counts
+// chess perft suite [depth]    reference positions (default depth 4)
+int perft_command(int argc, char **argv)
+{
+    static Board board;
+    int divide = strcmp(argv[0], "divide") == 0;
+
+    if (!divide && argc > 1 && strcmp(argv[1], "suite") == 0)
+        return perft_suite(argc > 2 ? atoi(argv[2]) : 4) ? 1 : 0;
+
+    if (argc < 2 || atoi(argv[1]) < 1)
+    {
+        printf("usage: %s <depth> [fen]\n       perft suite [depth]\n", argv[0]);
+        return 1;
+    }
+    int depth = atoi(argv[1]);
+
+    // The FEN may arrive as one quoted argument or as its separate fields
+    char fen[256] = STARTPOS_FEN;
+    if (argc > 2)
+    {
+        fen[0] = 0;
+        for (int i = 2; i < argc; i++)
+        {
+            strncat(fen, argv[i], sizeof(fen) - strlen(fen) - 2);
+            strcat(fen, " ");
+        }
+    }
+    if (!board_set_fen(&board, fen))
+    {
+        printf("Invalid FEN: %s\n", fen);
+        return 1;
+    }
+
+    if (divide)
+    {
+        perft_divide(&board, depth);
+        return 0;
+    }
+    for (int d = 1; d <= depth; d++)
+    {
+        long long start = now_ms();
+        uint64_t nodes = perft(&board, d);
+        printf("perft(%d) = %llu  (%lld ms)\n", d, (unsigned long long)nodes, now_ms() - start);
+        if (d == depth)
+            report(nodes, now_ms() - start);
+    }
+    return 0;
+}
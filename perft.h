@@ -0,0 +1,10 @@
+#ifndef PERFT_H
+#define PERFT_H
+#include "board.h"
+
+uint64_t perft(Board *b, int depth);
+uint64_t perft_divide(Board *b, int depth);
+int perft_suite(int max_depth);
+int perft_command(int argc, char **argv);
+
+#endif
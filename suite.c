@@ -0,0 +1,177 @@
+#include "suite.h"
+#include "ai.h"
+#include "tt.h"
+#include "epd.h"
+#include "util.h"
+
+// A position counts as solved when the search's last iteration plays a bm move (and no am
+// move). Its time to solution is that of the first iteration from which every later one
+// agreed: found and held, so a lucky early iteration that is dropped again does not count.
+
+// Solution of the position being searched, the report context of its search
+typedef struct
+{
+    const EpdPosition *position;
+    int depth; // 0 = not solved at the moment
+    uint64_t nodes;
+    long long time_ms;
+} Solution;
+
+static int move_in(const Move *m, const Move *list, int n)
+{
+    for (int i = 0; i < n; i++)
+        if (move_equal(m, &list[i]))
+            return 1;
+    return 0;
+}
+
+static int is_solution(const EpdPosition *p, const Move *m)
+{
+    return (p->n_bm == 0 || move_in(m, p->bm, p->n_bm)) && !move_in(m, p->am, p->n_am);
+}
+
+// Called after every completed iteration
+static void track_solution(const SearchResult *r, void *ctx)
+{
+    Solution *solution = (Solution *)ctx;
+    if (!is_solution(solution->position, &r->best))
+        solution->depth = 0;
+    else if (!solution->depth)
+    {
+        solution->depth = r->depth;
+        solution->nodes = r->nodes;
+        solution->time_ms = r->time_ms;
+    }
+}
+
+static void format_list(Board *b, const Move *moves, int n, char *out, size_t size)
+{
+    char san[16];
+    out[0] = 0;
+    for (int i = 0; i < n; i++)
+    {
+        format_san(b, &moves[i], san);
+        if (strlen(out) + strlen(san) + 2 < size)
+        {
+            if (i)
+                strcat(out, " ");
+            strcat(out, san);
+        }
+    }
+}
+
+int suite_run(const char *path, long long movetime_ms, int threads)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        printf("Cannot open %s\n", path);
+        return 0;
+    }
+    // A searcher and table of its own, so runs do not disturb other searches or each other
+    search_init();
+    Searcher *searcher = searcher_new(threads);
+    if (!searcher)
+    {
+        fclose(f);
+        return 0;
+    }
+    searcher_set_hash(searcher, TT_DEFAULT_MB);
+    EpdPosition pos;
+    GameRecord game;
+    game_init(&game);
+
+    printf("%-4s %-16s %-16s %-8s %-6s %6s %12s %10s\n", "#", "id", "expected", "played", "result", "depth", "nodes",
+           "time (ms)");
+    int total = 0, solved = 0;
+    long long solve_ms = 0, all_ms = 0;
+    uint64_t solve_nodes = 0, all_nodes = 0;
+    long solve_depth = 0;
+    char line[1024];
+    long line_no = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        line_no++;
+        if (!epd_parse(line, &pos))
+            continue;
+        if (!pos.n_bm && !pos.n_am)
+        {
+            printf("line %ld: no bm or am operation, skipped\n", line_no);
+            continue;
+        }
+
+        // Every position starts from an empty table so results do not depend on the order
+        searcher_new_game(searcher);
+        board_attach_game(&pos.board, &game);
+        Solution solution = {.position = &pos};
+        SearchLimits limits = {.movetime_ms = movetime_ms, .report = track_solution, .ctx = &solution};
+        SearchResult result;
+        if (!searcher_search(searcher, &pos.board, color_char(pos.board.side), &limits, &result))
+            continue; // mate or stalemate: nothing to find
+        total++;
+        all_ms += result.time_ms;
+        all_nodes += result.nodes;
+
+        char expected[64], played[16];
+        if (pos.n_bm)
+        {
+            strcpy(expected, "bm ");
+            format_list(&pos.board, pos.bm, pos.n_bm, expected + 3, sizeof(expected) - 3);
+        }
+        else
+        {
+            strcpy(expected, "am ");
+            format_list(&pos.board, pos.am, pos.n_am, expected + 3, sizeof(expected) - 3);
+        }
+        format_san(&pos.board, &result.best, played);
+
+        int ok = solution.depth > 0;
+        if (ok)
+        {
+            solved++;
+            solve_ms += solution.time_ms;
+            solve_nodes += solution.nodes;
+            solve_depth += solution.depth;
+            printf("%-4d %-16s %-16s %-8s %-6s %6d %12llu %10lld\n", total, pos.id[0] ? pos.id : "-", expected, played,
+                   "found", solution.depth, (unsigned long long)solution.nodes, solution.time_ms);
+        }
+        else
+            printf("%-4d %-16s %-16s %-8s %-6s %6d %12llu %10lld\n", total, pos.id[0] ? pos.id : "-", expected, played,
+                   "--", result.depth, (unsigned long long)result.nodes, result.time_ms);
+        fflush(stdout);
+    }
+    fclose(f);
+    game_free(&game);
+    searcher_free(searcher);
+
+    printf("\nsolved %d of %d (%.1f%%) at %lld ms per position, %d thread%s\n", solved, total,
+           total ? 100.0 * solved / total : 0.0, movetime_ms, threads, threads == 1 ? "" : "s");
+    if (solved)
+        printf("time to solution: mean %.0f ms, %.0f nodes, depth %.1f\n", (double)solve_ms / solved,
+               (double)solve_nodes / solved, (double)solve_depth / solved);
+    printf("total %llu nodes in %lld ms (%.0f nps)\n", (unsigned long long)all_nodes, all_ms,
+           all_ms > 0 ? (double)all_nodes * 1000.0 / (double)all_ms : 0.0);
+    return 1;
+}
+
+// chess suite FILE [movetime MS] [threads N]   default: 1000 ms per position, 1 thread
+int suite_command(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: suite FILE [movetime MS] [threads N]\n");
+        return 1;
+    }
+    long long movetime_ms = 1000;
+    int threads = 1;
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "movetime") == 0)
+            movetime_ms = atoll(argv[i + 1]);
+        else if (strcmp(argv[i], "threads") == 0)
+            threads = atoi(argv[i + 1]);
+    }
+    if (movetime_ms < 1)
+        movetime_ms = 1000;
+    return suite_run(argv[1], movetime_ms, threads) ? 0 : 1;
+}
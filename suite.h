@@ -0,0 +1,10 @@
+#ifndef SUITE_H
+#define SUITE_H
+#include "board.h"
+
+// Tactical test suites: EPD positions with bm/am operations, each searched under a time
+// limit, reporting the solve rate and how soon each solution was found and kept
+int suite_run(const char *path, long long movetime_ms, int threads);
+int suite_command(int argc, char **argv);
+
+#endif
\ No newline at end of file
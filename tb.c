@@ -0,0 +1,1337 @@
+#include "tb.h"
+#include "move_gen.h"
+#include "bitbase.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Syzygy tables are indexed with a1 = 0, h8 = 63 and the piece codes 1 + type + 8 * color,
+// which are our mailbox codes. Squares below are in that numbering: ours ^ 56.
+//
+// Reading a table: the position is mirrored so the stronger side is White and the leading
+// piece lands in a canonical corner, its pieces are combined into one index, and the
+// value at that index is decompressed from a canonical Huffman code whose symbols expand
+// recursively into pairs of symbols.
+
+#ifdef _WIN32
+#define TB_PATH_SEP ';'
+#else
+#define TB_PATH_SEP ':'
+#endif
+
+#define TB_PIECES 7
+#define TB_HASH_SIZE 8192 // open-addressing slots, over twice the keys of every 7-piece table
+#define TB_MAX_DTZ 262144
+
+enum
+{
+    TB_WDL_FILE,
+    TB_DTZ_FILE
+};
+
+// Flags of one compressed table
+enum
+{
+    TBF_STM = 1,           // DTZ: stored for this side to move
+    TBF_MAPPED = 2,        // DTZ: values go through a per-result map
+    TBF_WIN_PLIES = 4,     // DTZ: wins counted in plies, not moves
+    TBF_LOSS_PLIES = 8,    // DTZ: losses counted in plies
+    TBF_WIDE = 16,         // DTZ: 16-bit map entries
+    TBF_SINGLE_VALUE = 128 // every position holds the same value
+};
+
+// How a probe went
+enum
+{
+    PROBE_FAIL,       // a table is missing or unreadable
+    PROBE_OK,
+    PROBE_CHANGE_STM, // DTZ: the table holds the other side to move
+    PROBE_ZEROING     // DTZ: the best move is a capture or pawn move, whose value the table does not store
+};
+
+static const unsigned char TB_MAGIC[2][4] = {{0x71, 0xE8, 0x23, 0x5D}, {0xD7, 0x66, 0x0C, 0xA5}};
+static const char *TB_SUFFIX[2] = {".rtbw", ".rtbz"};
+
+// Decoding data of one table: per side to move, and per leading pawn file with pawns
+typedef struct
+{
+    int flags;
+    int max_sym_len, min_sym_len;
+    uint32_t num_blocks;
+    size_t block_size;                  // bytes per compressed block
+    size_t span;                        // one sparse index entry per `span` values
+    const unsigned char *lowest_sym;    // little-endian uint16 per symbol length: lowest symbol of that length
+    const unsigned char *btree;         // 3 bytes per symbol: the 12-bit left and right symbols it expands to
+    const unsigned char *block_length;  // little-endian uint16 per block: values stored minus one
+    uint32_t block_length_size;
+    const unsigned char *sparse_index;  // 6 bytes per entry: uint32 block, uint16 offset into it
+    size_t sparse_index_size;
+    const unsigned char *data;          // the compressed blocks
+    uint64_t *base64;                   // [length - min_sym_len]: lowest code of that length, left-aligned
+    int *symlen;                        // [symbol]: number of values it expands to, minus one
+    int n_symbols;
+    int pieces[TB_PIECES];              // piece order of the encoding
+    uint64_t group_idx[TB_PIECES + 1];  // index multiplier of each group of pieces
+    int group_len[TB_PIECES + 1];       // pieces per group, 0-terminated
+    int map_idx[4];                     // DTZ: map start per result (win, loss, cursed win, blessed loss)
+} PairsData;
+
+typedef struct
+{
+    const unsigned char *base; // mapped file, NULL if missing
+    size_t size;
+    int ready;                 // mapping attempted (read with acquire ordering)
+    const unsigned char *map;  // DTZ value maps
+    PairsData items[2][4];     // [side to move][leading pawn file a-d, 0 without pawns]
+} TBFile;
+
+typedef struct
+{
+    char name[TB_PIECES + 2]; // e.g. "KRvKP", stronger side first
+    uint64_t key;             // material with the first side as White
+    uint64_t key2;            // ... and as Black
+    int piece_count;
+    int has_pawns;
+    int has_unique_pieces;    // some side owns exactly one of a non-king piece type
+    int pawn_count[2];        // [leading color, other]: leading = fewer pawns, but not none
+    TBFile file[2];           // [TB_WDL_FILE, TB_DTZ_FILE]
+} TBTable;
+
+static char *tb_paths = NULL;
+static TBTable *tables = NULL;
+static int n_tables = 0, tables_cap = 0;
+static int table_hash[TB_HASH_SIZE]; // index + 1, 0 = empty
+static int largest = 0;
+static int use_rule50 = 1;
+static int probe_depth = 1;
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Index tables
+static int map_pawns[64];     // a2-h7 to 0..47, higher = nearer the a/h edge, then lower rank
+static int map_b1h1h7[64];    // squares below the a1-h8 diagonal to 0..27
+static int map_a1d1d4[64];    // the a1-d1-d4 triangle to 0..9, diagonal last
+static int map_kk[10][64];    // the 462 placements of two kings, first in the triangle
+static uint64_t binomial[TB_PIECES][64];
+static int lead_pawn_idx[TB_PIECES][64];
+static int lead_pawns_size[TB_PIECES][4];
+
+static inline int tb_rank(int sq) { return sq >> 3; }
+static inline int tb_file(int sq) { return sq & 7; }
+static inline int off_diagonal(int sq) { return tb_rank(sq) - tb_file(sq); } // < 0 below a1-h8
+
+static uint32_t read_le16(const unsigned char *p) { return p[0] | (uint32_t)p[1] << 8; }
+static uint32_t read_le32(const unsigned char *p) { return read_le16(p) | read_le16(p + 2) << 16; }
+static uint32_t read_be32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+static uint64_t read_be64(const unsigned char *p) { return (uint64_t)read_be32(p) << 32 | read_be32(p + 4); }
+
+static void init_indices(void)
+{
+    static int done = 0;
+    if (done)
+        return;
+    done = 1;
+
+    int code = 0;
+    for (int sq = 0; sq < 64; sq++)
+        if (off_diagonal(sq) < 0)
+            map_b1h1h7[sq] = code++;
+
+    int diagonal[4], n_diagonal = 0;
+    code = 0;
+    for (int sq = 0; sq <= 27; sq++) // a1..d4
+    {
+        if (off_diagonal(sq) < 0 && tb_file(sq) <= 3)
+            map_a1d1d4[sq] = code++;
+        else if (off_diagonal(sq) == 0 && tb_file(sq) <= 3)
+            diagonal[n_diagonal++] = sq;
+    }
+    for (int i = 0; i < n_diagonal; i++)
+        map_a1d1d4[diagonal[i]] = code++;
+
+    // Kings touching are illegal; with the first king on the diagonal the second stays
+    // on or below it. Both on the diagonal come last.
+    int both_idx[64 * 4], both_sq[64 * 4], n_both = 0;
+    code = 0;
+    for (int idx = 0; idx < 10; idx++)
+        for (int s1 = 0; s1 <= 27; s1++)
+        {
+            if (map_a1d1d4[s1] != idx || (idx == 0 && s1 != 1)) // b1 is the 0
+                continue;
+            for (int s2 = 0; s2 < 64; s2++)
+            {
+                if (abs(tb_rank(s1) - tb_rank(s2)) <= 1 && abs(tb_file(s1) - tb_file(s2)) <= 1)
+                    continue;
+                if (!off_diagonal(s1) && off_diagonal(s2) > 0)
+                    continue;
+                if (!off_diagonal(s1) && !off_diagonal(s2))
+                {
+                    both_idx[n_both] = idx;
+                    both_sq[n_both++] = s2;
+                }
+                else
+                    map_kk[idx][s2] = code++;
+            }
+        }
+    for (int i = 0; i < n_both; i++)
+        map_kk[both_idx[i]][both_sq[i]] = code++;
+
+    binomial[0][0] = 1;
+    for (int n = 1; n < 64; n++)
+        for (int k = 0; k < TB_PIECES && k <= n; k++)
+            binomial[k][n] = (k > 0 ? binomial[k - 1][n - 1] : 0) + (k < n ? binomial[k][n - 1] : 0);
+
+    // Leading pawns: the one with the highest map_pawns is the lead; the others can only
+    // stand on squares with lower values
+    int available = 47;
+    for (int count = 1; count < TB_PIECES - 1; count++)
+        for (int f = 0; f < 4; f++)
+        {
+            int idx = 0;
+            for (int r = 1; r <= 6; r++)
+            {
+                int sq = r * 8 + f;
+                if (count == 1)
+                {
+                    map_pawns[sq] = available--;
+                    map_pawns[sq ^ 7] = available--;
+                }
+                lead_pawn_idx[count][sq] = idx;
+                idx += (int)binomial[count - 1][map_pawns[sq]];
+            }
+            lead_pawns_size[count][f] = idx;
+        }
+}
+
+// Piece counts packed 4 bits per color and type, kings left out
+static uint64_t material_key_counts(const int counts[2][5])
+{
+    uint64_t key = 0;
+    for (int c = 0; c < 2; c++)
+        for (int t = 0; t < 5; t++)
+            key |= (uint64_t)counts[c][t] << (4 * (t + 5 * c));
+    return key;
+}
+
+static uint64_t material_key(const Board *b)
+{
+    int counts[2][5];
+    for (int c = 0; c < 2; c++)
+        for (int t = 0; t < 5; t++)
+            counts[c][t] = popcount(board_pieces(b, c, t));
+    return material_key_counts(counts);
+}
+
+static TBTable *find_table(uint64_t key)
+{
+    for (unsigned h = (unsigned)(key * 0x9E3779B97F4A7C15ULL >> 51);; h = (h + 1) & (TB_HASH_SIZE - 1))
+    {
+        int i = table_hash[h];
+        if (i == 0)
+            return NULL;
+        if (tables[i - 1].key == key || tables[i - 1].key2 == key)
+            return &tables[i - 1];
+    }
+}
+
+static void hash_insert(uint64_t key, int index)
+{
+    unsigned h = (unsigned)(key * 0x9E3779B97F4A7C15ULL >> 51);
+    while (table_hash[h])
+        h = (h + 1) & (TB_HASH_SIZE - 1);
+    table_hash[h] = index + 1;
+}
+
+static FILE *open_in_paths(const char *name, char *path, size_t path_size)
+{
+    const char *dir = tb_paths;
+    while (dir && *dir)
+    {
+        const char *end = strchr(dir, TB_PATH_SEP);
+        int len = end ? (int)(end - dir) : (int)strlen(dir);
+        if (len > 0)
+        {
+            snprintf(path, path_size, "%.*s/%s", len, dir, name);
+            FILE *f = fopen(path, "rb");
+            if (f)
+                return f;
+        }
+        dir = end ? end + 1 : NULL;
+    }
+    return NULL;
+}
+
+// Register a table if its .rtbw file exists. `code` lists the pieces, stronger side
+// first: "KRKP" is looked up as KRvKP.rtbw.
+static void add_table(const char *code)
+{
+    const char *split = strchr(code + 1, 'K');
+    char name[TB_PIECES + 2], path[1024];
+    snprintf(name, sizeof(name), "%.*sv%s", (int)(split - code), code, split);
+    char file_name[32];
+    snprintf(file_name, sizeof(file_name), "%s%s", name, TB_SUFFIX[TB_WDL_FILE]);
+    FILE *f = open_in_paths(file_name, path, sizeof(path));
+    if (!f)
+        return;
+    fclose(f);
+
+    if (n_tables == tables_cap)
+    {
+        int cap = tables_cap ? tables_cap * 2 : 64;
+        TBTable *grown = (TBTable *)realloc(tables, sizeof(TBTable) * cap);
+        if (!grown)
+            return;
+        tables = grown;
+        tables_cap = cap;
+    }
+    TBTable *e = &tables[n_tables];
+    memset(e, 0, sizeof(*e));
+    strcpy(e->name, name);
+
+    int counts[2][5] = {{0}};
+    int side = 0;
+    for (const char *p = name; *p; p++)
+    {
+        if (*p == 'v')
+            side = 1;
+        else if (*p != 'K')
+            counts[side][piece_index(*p)]++;
+        e->piece_count += *p != 'v';
+    }
+    e->key = material_key_counts(counts);
+    int swapped[2][5];
+    for (int t = 0; t < 5; t++)
+    {
+        swapped[0][t] = counts[1][t];
+        swapped[1][t] = counts[0][t];
+        e->has_unique_pieces |= counts[0][t] == 1 || counts[1][t] == 1;
+    }
+    e->key2 = material_key_counts(swapped);
+    e->has_pawns = counts[0][PAWN] + counts[1][PAWN] > 0;
+
+    // Leading color: the side with fewer pawns, when it has any
+    int lead = !counts[BLACK][PAWN] || (counts[WHITE][PAWN] && counts[BLACK][PAWN] >= counts[WHITE][PAWN]) ? WHITE : BLACK;
+    e->pawn_count[0] = counts[lead][PAWN];
+    e->pawn_count[1] = counts[!lead][PAWN];
+
+    hash_insert(e->key, n_tables);
+    if (e->key2 != e->key)
+        hash_insert(e->key2, n_tables);
+    n_tables++;
+    if (e->piece_count > largest)
+        largest = e->piece_count;
+}
+
+static void free_file(TBFile *f)
+{
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 4; j++)
+        {
+            free(f->items[i][j].base64);
+            free(f->items[i][j].symlen);
+        }
+    if (f->base)
+    {
+#ifdef _WIN32
+        free((void *)f->base);
+#else
+        munmap((void *)f->base, f->size);
+#endif
+    }
+    memset(f, 0, sizeof(*f));
+}
+
+void tb_free(void)
+{
+    for (int i = 0; i < n_tables; i++)
+        for (int j = 0; j < 2; j++)
+            free_file(&tables[i].file[j]);
+    free(tables);
+    free(tb_paths);
+    tables = NULL;
+    tb_paths = NULL;
+    n_tables = tables_cap = largest = 0;
+    memset(table_hash, 0, sizeof(table_hash));
+}
+
+static int check_known_results(void);
+
+int tb_init(const char *paths)
+{
+    tb_free();
+    if (!paths || !*paths || strcmp(paths, "<empty>") == 0)
+        return 0;
+    tb_paths = strdup(paths);
+    init_indices();
+
+    // Every material split up to 7 pieces, stronger side first, pieces strongest first
+    static const char P[] = "PNBRQ";
+#define ADD(...)                                   \
+    do                                             \
+    {                                              \
+        const char code[] = {__VA_ARGS__, 0};      \
+        add_table(code);                           \
+    } while (0)
+    for (int p1 = 0; p1 < 5; p1++)
+    {
+        ADD('K', P[p1], 'K');
+        for (int p2 = 0; p2 <= p1; p2++)
+        {
+            ADD('K', P[p1], P[p2], 'K');
+            ADD('K', P[p1], 'K', P[p2]);
+            for (int p3 = 0; p3 < 5; p3++)
+                ADD('K', P[p1], P[p2], 'K', P[p3]);
+            for (int p3 = 0; p3 <= p2; p3++)
+            {
+                ADD('K', P[p1], P[p2], P[p3], 'K');
+                for (int p4 = 0; p4 <= p3; p4++)
+                {
+                    ADD('K', P[p1], P[p2], P[p3], P[p4], 'K');
+                    for (int p5 = 0; p5 <= p4; p5++)
+                        ADD('K', P[p1], P[p2], P[p3], P[p4], P[p5], 'K');
+                    for (int p5 = 0; p5 < 5; p5++)
+                        ADD('K', P[p1], P[p2], P[p3], P[p4], 'K', P[p5]);
+                }
+                for (int p4 = 0; p4 < 5; p4++)
+                {
+                    ADD('K', P[p1], P[p2], P[p3], 'K', P[p4]);
+                    for (int p5 = 0; p5 <= p4; p5++)
+                        ADD('K', P[p1], P[p2], P[p3], 'K', P[p4], P[p5]);
+                }
+            }
+            for (int p3 = 0; p3 <= p1; p3++)
+                for (int p4 = 0; p4 <= (p1 == p3 ? p2 : p3); p4++)
+                    ADD('K', P[p1], P[p2], 'K', P[p3], P[p4]);
+        }
+    }
+#undef ADD
+    if (largest && !check_known_results())
+    {
+        fprintf(stderr, "tb: tables in %s give wrong results, not using them\n", paths);
+        tb_free();
+    }
+    return largest;
+}
+
+int tb_largest(void)
+{
+    return largest;
+}
+
+void tb_set_rule50(int on)
+{
+    use_rule50 = on;
+}
+
+int tb_rule50(void)
+{
+    return use_rule50;
+}
+
+void tb_set_probe_depth(int depth)
+{
+    probe_depth = depth;
+}
+
+int tb_probe_depth(void)
+{
+    return probe_depth;
+}
+
+// ---- table layout ----
+
+// Split the pieces into groups and give each group its index multiplier. The leading
+// group is the first two or three unique pieces (or the leading pawns); the others are
+// runs of identical pieces. `order` says which position each group takes in the index.
+static void set_groups(const TBTable *e, PairsData *d, const int order[2], int f)
+{
+    int n = 0, first_len = e->has_pawns ? 0 : e->has_unique_pieces ? 3 : 2;
+    d->group_len[n] = 1;
+    for (int i = 1; i < e->piece_count; i++)
+    {
+        if (--first_len > 0 || d->pieces[i] == d->pieces[i - 1])
+            d->group_len[n]++;
+        else
+            d->group_len[++n] = 1;
+    }
+    d->group_len[++n] = 0;
+
+    int pp = e->has_pawns && e->pawn_count[1]; // pawns on both sides
+    int next = pp ? 2 : 1;
+    int free_squares = 64 - d->group_len[0] - (pp ? d->group_len[1] : 0);
+    uint64_t idx = 1;
+    for (int k = 0; next < n || k == order[0] || k == order[1]; k++)
+    {
+        if (k == order[0])
+        {
+            d->group_idx[0] = idx;
+            idx *= e->has_pawns ? (uint64_t)lead_pawns_size[d->group_len[0]][f] : e->has_unique_pieces ? 31332 : 462;
+        }
+        else if (k == order[1])
+        {
+            d->group_idx[1] = idx;
+            idx *= binomial[d->group_len[1]][48 - d->group_len[0]];
+        }
+        else
+        {
+            d->group_idx[next] = idx;
+            idx *= binomial[d->group_len[next]][free_squares];
+            free_squares -= d->group_len[next++];
+        }
+    }
+    d->group_idx[n] = idx;
+}
+
+static int btree_left(const PairsData *d, int sym)
+{
+    const unsigned char *lr = d->btree + 3 * sym;
+    return (lr[1] & 0xF) << 8 | lr[0];
+}
+
+static int btree_right(const PairsData *d, int sym)
+{
+    const unsigned char *lr = d->btree + 3 * sym;
+    return lr[2] << 4 | lr[1] >> 4;
+}
+
+static int set_symlen(PairsData *d, int sym, unsigned char *visited)
+{
+    visited[sym] = 1;
+    int right = btree_right(d, sym);
+    if (right == 0xFFF)
+        return 0; // a leaf: one value
+    int left = btree_left(d, sym);
+    if (!visited[left])
+        d->symlen[left] = set_symlen(d, left, visited);
+    if (!visited[right])
+        d->symlen[right] = set_symlen(d, right, visited);
+    return d->symlen[left] + d->symlen[right] + 1;
+}
+
+// NULL when out of memory
+static const unsigned char *set_sizes(PairsData *d, const unsigned char *data)
+{
+    d->flags = *data++;
+    if (d->flags & TBF_SINGLE_VALUE)
+    {
+        d->num_blocks = d->block_length_size = 0;
+        d->span = d->sparse_index_size = 0;
+        d->min_sym_len = *data++; // the value
+        return data;
+    }
+
+    int groups = 0;
+    while (d->group_len[groups])
+        groups++;
+    uint64_t tb_size = d->group_idx[groups];
+
+    d->block_size = (size_t)1 << *data++;
+    d->span = (size_t)1 << *data++;
+    d->sparse_index_size = (size_t)((tb_size + d->span - 1) / d->span);
+    int padding = *data++;
+    d->num_blocks = read_le32(data);
+    data += 4;
+    d->block_length_size = d->num_blocks + padding; // keeps the sparse index in range
+    d->max_sym_len = *data++;
+    d->min_sym_len = *data++;
+    d->lowest_sym = data;
+
+    // Canonical Huffman: longer codes have lower values. base64[i] is the lowest code of
+    // length min_sym_len + i, left-aligned in 64 bits, so a code's length is the first i
+    // with buffer >= base64[i].
+    int lengths = d->max_sym_len - d->min_sym_len + 1;
+    d->base64 = (uint64_t *)calloc(lengths, sizeof(uint64_t));
+    if (!d->base64)
+        return NULL;
+    for (int i = lengths - 2; i >= 0; i--)
+        d->base64[i] = (d->base64[i + 1] + read_le16(d->lowest_sym + 2 * i) - read_le16(d->lowest_sym + 2 * (i + 1))) / 2;
+    for (int i = 0; i < lengths; i++)
+        d->base64[i] <<= 64 - i - d->min_sym_len;
+    data += 2 * lengths;
+
+    d->n_symbols = (int)read_le16(data);
+    data += 2;
+    d->btree = data;
+    d->symlen = (int *)calloc(d->n_symbols, sizeof(int));
+    unsigned char *visited = (unsigned char *)calloc(d->n_symbols, 1);
+    if (!d->symlen || !visited)
+    {
+        free(visited);
+        return NULL; // symlen is freed with the file
+    }
+    for (int sym = 0; sym < d->n_symbols; sym++)
+        if (!visited[sym])
+            d->symlen[sym] = set_symlen(d, sym, visited);
+    free(visited);
+    return data + 3 * d->n_symbols + (d->n_symbols & 1);
+}
+
+static const unsigned char *set_dtz_map(TBTable *e, const unsigned char *data, const unsigned char *base, int max_file)
+{
+    TBFile *file = &e->file[TB_DTZ_FILE];
+    file->map = data;
+    for (int f = 0; f <= max_file; f++)
+    {
+        PairsData *d = &file->items[0][f];
+        if (!(d->flags & TBF_MAPPED))
+            continue;
+        if (d->flags & TBF_WIDE)
+        {
+            data += (data - base) & 1;
+            for (int i = 0; i < 4; i++)
+            {
+                d->map_idx[i] = (int)((data - file->map) / 2 + 1);
+                data += 2 * read_le16(data) + 2;
+            }
+        }
+        else
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                d->map_idx[i] = (int)(data - file->map + 1);
+                data += *data + 1;
+            }
+        }
+    }
+    return data + ((data - base) & 1);
+}
+
+// Point the decoding data into a freshly mapped file; 0 if it does not fit the table or
+// memory runs out
+static int set_tables(TBTable *e, int type, const unsigned char *base, size_t size)
+{
+    TBFile *file = &e->file[type];
+    const unsigned char *data = base + 4;
+    if (!(data[0] & 2) != !e->has_pawns)
+        return 0;
+    data++;
+
+    int sides = type == TB_WDL_FILE && e->key != e->key2 ? 2 : 1;
+    int max_file = e->has_pawns ? 3 : 0;
+    int pp = e->has_pawns && e->pawn_count[1];
+    for (int f = 0; f <= max_file; f++)
+    {
+        int order[2][2] = {{data[0] & 0xF, pp ? data[1] & 0xF : 0xF}, {data[0] >> 4, pp ? data[1] >> 4 : 0xF}};
+        data += 1 + pp;
+        for (int k = 0; k < e->piece_count; k++, data++)
+            for (int i = 0; i < sides; i++)
+                file->items[i][f].pieces[k] = i ? *data >> 4 : *data & 0xF;
+        for (int i = 0; i < sides; i++)
+            set_groups(e, &file->items[i][f], order[i], f);
+    }
+    data += (data - base) & 1;
+
+    for (int f = 0; f <= max_file; f++)
+        for (int i = 0; i < sides; i++)
+            if (!(data = set_sizes(&file->items[i][f], data)))
+                return 0;
+    if (type == TB_DTZ_FILE)
+        data = set_dtz_map(e, data, base, max_file);
+    for (int f = 0; f <= max_file; f++)
+        for (int i = 0; i < sides; i++)
+        {
+            file->items[i][f].sparse_index = data;
+            data += 6 * file->items[i][f].sparse_index_size;
+        }
+    for (int f = 0; f <= max_file; f++)
+        for (int i = 0; i < sides; i++)
+        {
+            file->items[i][f].block_length = data;
+            data += 2 * (size_t)file->items[i][f].block_length_size;
+        }
+    for (int f = 0; f <= max_file; f++)
+        for (int i = 0; i < sides; i++)
+        {
+            data = base + (((size_t)(data - base) + 63) & ~(size_t)63);
+            file->items[i][f].data = data;
+            data += (size_t)file->items[i][f].num_blocks * file->items[i][f].block_size;
+        }
+    return data <= base + size;
+}
+
+static const unsigned char *map_file(const char *name, size_t *size)
+{
+    char path[1024];
+    FILE *f = open_in_paths(name, path, sizeof(path));
+    if (!f)
+        return NULL;
+#ifdef _WIN32
+    // No mmap: read the whole file instead
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *data = len > 0 ? (unsigned char *)malloc((size_t)len) : NULL;
+    if (!data || fread(data, 1, (size_t)len, f) != (size_t)len)
+    {
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+#else
+    fclose(f);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 16)
+    {
+        close(fd);
+        return NULL;
+    }
+    off_t len = st.st_size;
+    void *data = mmap(NULL, (size_t)len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+#endif
+    *size = (size_t)len;
+    return (const unsigned char *)data;
+}
+
+// Map a table file on first use. Threads race here only until the first mapping is done.
+static int map_table(TBTable *e, int type)
+{
+    TBFile *file = &e->file[type];
+    if (__atomic_load_n(&file->ready, __ATOMIC_ACQUIRE))
+        return file->base != NULL;
+
+    pthread_mutex_lock(&map_lock);
+    if (!file->ready)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%s%s", e->name, TB_SUFFIX[type]);
+        size_t size = 0;
+        const unsigned char *base = map_file(name, &size);
+        if (base && memcmp(base, TB_MAGIC[type], 4) == 0 && set_tables(e, type, base, size))
+        {
+            file->base = base;
+            file->size = size;
+        }
+        else
+        {
+            // ready stays set, so a missing or rejected file is not retried on every probe
+            if (base)
+            {
+                fprintf(stderr, "tb: cannot read %s (corrupt, not a Syzygy table, or out of memory)\n", name);
+                file->base = base;
+                file->size = size;
+                free_file(file);
+            }
+        }
+        __atomic_store_n(&file->ready, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&map_lock);
+    return file->base != NULL;
+}
+
+// ---- decoding ----
+
+// The value at `idx`: find its block through the sparse index, walk the block's Huffman
+// symbols up to it, then descend the pair tree to the single value
+static int decompress_pairs(const PairsData *d, uint64_t idx)
+{
+    if (d->flags & TBF_SINGLE_VALUE)
+        return d->min_sym_len;
+
+    // Entry k describes the value at k * span + span / 2
+    uint32_t k = (uint32_t)(idx / d->span);
+    uint32_t block = read_le32(d->sparse_index + 6 * (size_t)k);
+    int offset = (int)read_le16(d->sparse_index + 6 * (size_t)k + 4);
+    offset += (int)(idx % d->span) - (int)(d->span / 2);
+
+    while (offset < 0)
+        offset += (int)read_le16(d->block_length + 2 * (size_t)--block) + 1;
+    while (offset > (int)read_le16(d->block_length + 2 * (size_t)block))
+        offset -= (int)read_le16(d->block_length + 2 * (size_t)block++) + 1;
+
+    const unsigned char *ptr = d->data + (uint64_t)block * d->block_size;
+    uint64_t buf = read_be64(ptr);
+    ptr += 8;
+    int buf_size = 64;
+    int sym;
+    while (1)
+    {
+        int len = 0;
+        while (buf < d->base64[len])
+            len++;
+        sym = (int)((buf - d->base64[len]) >> (64 - len - d->min_sym_len));
+        sym = (uint16_t)(sym + read_le16(d->lowest_sym + 2 * len));
+        if (offset < d->symlen[sym] + 1)
+            break;
+        offset -= d->symlen[sym] + 1;
+        len += d->min_sym_len;
+        buf <<= len;
+        buf_size -= len;
+        if (buf_size <= 32)
+        {
+            buf_size += 32;
+            buf |= (uint64_t)read_be32(ptr) << (64 - buf_size);
+            ptr += 4;
+        }
+    }
+
+    while (d->symlen[sym])
+    {
+        int left = btree_left(d, sym);
+        if (offset < d->symlen[left] + 1)
+            sym = left;
+        else
+        {
+            offset -= d->symlen[left] + 1;
+            sym = btree_right(d, sym);
+        }
+    }
+    return btree_left(d, sym);
+}
+
+// DTZ values come in moves unless flagged as plies, and may go through a per-result map
+static int map_dtz(const TBTable *e, int f, int value, int wdl)
+{
+    static const int WDL_MAP[5] = {1, 3, 0, 2, 0}; // [wdl + 2] -> map_idx slot
+    const TBFile *file = &e->file[TB_DTZ_FILE];
+    const PairsData *d = &file->items[0][f];
+    if (d->flags & TBF_MAPPED)
+    {
+        int start = d->map_idx[WDL_MAP[wdl + 2]];
+        if (d->flags & TBF_WIDE)
+            value = (int)read_le16(file->map + 2 * (size_t)(start + value));
+        else
+            value = file->map[start + value];
+    }
+    if ((wdl == TB_WIN && !(d->flags & TBF_WIN_PLIES)) || (wdl == TB_LOSS && !(d->flags & TBF_LOSS_PLIES)) ||
+        wdl == TB_CURSED_WIN || wdl == TB_BLESSED_LOSS)
+        value *= 2;
+    return value + 1;
+}
+
+static int by_map_pawns(const void *a, const void *b)
+{
+    return map_pawns[*(const int *)a] - map_pawns[*(const int *)b];
+}
+
+static int by_square(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+// Sort that keeps equal elements in order; n is at most TB_PIECES
+static void small_sort(int *v, int n, int (*cmp)(const void *, const void *))
+{
+    for (int i = 1; i < n; i++)
+    {
+        int cur = v[i], j = i - 1;
+        while (j >= 0 && cmp(&v[j], &cur) > 0)
+        {
+            v[j + 1] = v[j];
+            j--;
+        }
+        v[j + 1] = cur;
+    }
+}
+
+// The stored value of the position: WDL result, or DTZ (for `wdl`)
+static int probe_table(Board *b, int type, int wdl, int *state)
+{
+    Bitboard occ = board_occupied(b);
+    if (popcount(occ) == 2)
+        return 0; // bare kings
+    uint64_t key = material_key(b);
+    TBTable *e = find_table(key);
+    if (!e || !map_table(e, type))
+    {
+        *state = PROBE_FAIL;
+        return 0;
+    }
+    TBFile *file = &e->file[type];
+
+    // Tables hold the stronger side as White, and symmetric material with White to move
+    // only: otherwise swap the colors and mirror the ranks. The ^ 56 also turns our
+    // square numbering into the tables' one.
+    int flip = (e->key == e->key2 && b->side == BLACK) || key != e->key;
+    int flip_color = flip * 8;
+    int flip_squares = flip ? 0 : 56;
+    int stm = flip ^ b->side;
+
+    int squares[TB_PIECES], pieces[TB_PIECES];
+    int size = 0, lead_count = 0, f = 0;
+    Bitboard lead_pawns = 0;
+    if (e->has_pawns)
+    {
+        // Pawn tables are split by the file of the leading pawn, the one nearest the edge
+        int pc = file->items[0][0].pieces[0] ^ flip_color;
+        Bitboard bb = lead_pawns = board_pieces(b, piece_color(pc), PAWN);
+        while (bb)
+            squares[size++] = pop_lsb(&bb) ^ flip_squares;
+        lead_count = size;
+        int lead = 0;
+        for (int i = 1; i < lead_count; i++)
+            if (map_pawns[squares[i]] > map_pawns[squares[lead]])
+                lead = i;
+        int tmp = squares[0];
+        squares[0] = squares[lead];
+        squares[lead] = tmp;
+        f = tb_file(squares[0]) < 4 ? tb_file(squares[0]) : 7 - tb_file(squares[0]);
+    }
+
+    // DTZ tables store one side to move only
+    if (type == TB_DTZ_FILE && (file->items[0][f].flags & TBF_STM) != stm && !(e->key == e->key2 && !e->has_pawns))
+    {
+        *state = PROBE_CHANGE_STM;
+        return 0;
+    }
+
+    Bitboard bb = occ ^ lead_pawns;
+    while (bb)
+    {
+        int sq = pop_lsb(&bb);
+        squares[size] = sq ^ flip_squares;
+        pieces[size++] = b->squares[sq] ^ flip_color;
+    }
+
+    PairsData *d = &file->items[type == TB_WDL_FILE ? stm : 0][f];
+
+    // Put the pieces in the order the table encodes them
+    for (int i = lead_count; i < size - 1; i++)
+        for (int j = i + 1; j < size; j++)
+            if (d->pieces[i] == pieces[j])
+            {
+                int t = pieces[i];
+                pieces[i] = pieces[j];
+                pieces[j] = t;
+                t = squares[i];
+                squares[i] = squares[j];
+                squares[j] = t;
+                break;
+            }
+
+    // Mirror the files so the leading piece is on files a-d
+    if (tb_file(squares[0]) > 3)
+        for (int i = 0; i < size; i++)
+            squares[i] ^= 7;
+
+    uint64_t idx;
+    if (e->has_pawns)
+    {
+        idx = lead_pawn_idx[lead_count][squares[0]];
+        small_sort(squares + 1, lead_count - 1, by_map_pawns);
+        for (int i = 1; i < lead_count; i++)
+            idx += binomial[i][map_pawns[squares[i]]];
+    }
+    else
+    {
+        // Without pawns the board has all 8 symmetries: the leading piece goes to a1-d1-d4,
+        // and the first leading piece off the a1-h8 diagonal goes below it
+        if (tb_rank(squares[0]) > 3)
+            for (int i = 0; i < size; i++)
+                squares[i] ^= 56;
+        for (int i = 0; i < d->group_len[0]; i++)
+        {
+            if (!off_diagonal(squares[i]))
+                continue;
+            if (off_diagonal(squares[i]) > 0)
+                for (int j = i; j < size; j++)
+                    squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+            break;
+        }
+
+        if (e->has_unique_pieces)
+        {
+            // Three unique pieces together; later squares skip those already taken
+            int adjust1 = squares[1] > squares[0];
+            int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+            if (off_diagonal(squares[0]))
+                idx = ((uint64_t)map_a1d1d4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+            else if (off_diagonal(squares[1]))
+                idx = ((uint64_t)6 * 63 + tb_rank(squares[0]) * 28 + map_b1h1h7[squares[1]]) * 62 + squares[2] - adjust2;
+            else if (off_diagonal(squares[2]))
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + tb_rank(squares[0]) * 7 * 28 + (tb_rank(squares[1]) - adjust1) * 28 +
+                      map_b1h1h7[squares[2]];
+            else
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + tb_rank(squares[0]) * 7 * 6 +
+                      (tb_rank(squares[1]) - adjust1) * 6 + (tb_rank(squares[2]) - adjust2);
+        }
+        else
+            idx = map_kk[map_a1d1d4[squares[0]]][squares[1]];
+    }
+
+    // The other groups, each as a combination of the squares not taken by earlier groups
+    idx *= d->group_idx[0];
+    int *group = squares + d->group_len[0];
+    int remaining_pawns = e->has_pawns && e->pawn_count[1];
+    for (int next = 1; d->group_len[next]; next++)
+    {
+        int len = d->group_len[next];
+        small_sort(group, len, by_square);
+        uint64_t n = 0;
+        for (int i = 0; i < len; i++)
+        {
+            int adjust = 0;
+            for (int *s = squares; s < group; s++)
+                adjust += group[i] > *s;
+            n += binomial[i + 1][group[i] - adjust - 8 * remaining_pawns];
+        }
+        remaining_pawns = 0;
+        idx += n * d->group_idx[next];
+        group += len;
+    }
+
+    int value = decompress_pairs(d, idx);
+    return type == TB_WDL_FILE ? value - 2 : map_dtz(e, f, value, wdl);
+}
+
+// ---- probing ----
+
+static int is_capture(const Board *b, const Move *m)
+{
+    int to = SQ(m->to_x, m->to_y);
+    return b->squares[to] != NO_PIECE ||
+           (to == b->ep_square && piece_type(b->squares[SQ(m->from_x, m->from_y)]) == PAWN);
+}
+
+static int is_pawn_move(const Board *b, const Move *m)
+{
+    return piece_type(b->squares[SQ(m->from_x, m->from_y)]) == PAWN;
+}
+
+static int is_mate(Board *b)
+{
+    Move moves[256];
+    int n = 0;
+    if (!is_square_attacked(b, b->king_sq[b->side], !b->side))
+        return 0;
+    generate_legal_moves(b, b->side, ~0ULL, 0, moves, &n);
+    return n == 0;
+}
+
+// The tables leave positions where a capture (or, with check_zeroing, a pawn move) is
+// best as "don't care" values, and know nothing of en passant: play those moves out and
+// combine their results with the stored value.
+static int probe_ab(Board *b, int check_zeroing, int *state)
+{
+    Move moves[256];
+    int n = 0, searched = 0;
+    int best = TB_LOSS, value;
+    generate_legal_moves(b, b->side, ~0ULL, 0, moves, &n);
+    for (int i = 0; i < n; i++)
+    {
+        if (!is_capture(b, &moves[i]) && (!check_zeroing || !is_pawn_move(b, &moves[i])))
+            continue;
+        searched++;
+        Snapshot snap;
+        make_move(b, &moves[i], &snap);
+        value = -probe_ab(b, 0, state);
+        undo_move(b, &moves[i], &snap);
+        if (*state == PROBE_FAIL)
+            return TB_DRAW;
+        if (value > best)
+        {
+            best = value;
+            if (value >= TB_WIN)
+            {
+                *state = PROBE_ZEROING;
+                return value;
+            }
+        }
+    }
+
+    // With every legal move already tried the stored value is not needed (and could be
+    // wrong, e.g. with en passant available)
+    int all_searched = searched && searched == n;
+    if (all_searched)
+        value = best;
+    else
+    {
+        value = probe_table(b, TB_WDL_FILE, 0, state);
+        if (*state == PROBE_FAIL)
+            return TB_DRAW;
+    }
+    if (best >= value)
+    {
+        *state = best > TB_DRAW || all_searched ? PROBE_ZEROING : PROBE_OK;
+        return best;
+    }
+    *state = PROBE_OK;
+    return value;
+}
+
+// DTZ of the position just before a zeroing move into a position with this result
+static int dtz_before_zeroing(int wdl)
+{
+    return wdl == TB_WIN ? 1 : wdl == TB_CURSED_WIN ? 101 : wdl == TB_BLESSED_LOSS ? -101 : wdl == TB_LOSS ? -1 : 0;
+}
+
+static int sign_of(int v)
+{
+    return (v > 0) - (v < 0);
+}
+
+static int probe_dtz(Board *b, int *state)
+{
+    *state = PROBE_OK;
+    int wdl = probe_ab(b, 1, state);
+    if (*state == PROBE_FAIL || wdl == TB_DRAW)
+        return 0;
+    if (*state == PROBE_ZEROING)
+        return dtz_before_zeroing(wdl);
+
+    int dtz = probe_table(b, TB_DTZ_FILE, wdl, state);
+    if (*state == PROBE_FAIL)
+        return 0;
+    if (*state != PROBE_CHANGE_STM)
+        return (dtz + 100 * (wdl == TB_BLESSED_LOSS || wdl == TB_CURSED_WIN)) * sign_of(wdl);
+
+    // The table holds the other side to move: take the best move one ply deeper
+    Move moves[256];
+    int n = 0, min_dtz = 0xFFFF;
+    generate_legal_moves(b, b->side, ~0ULL, 0, moves, &n);
+    for (int i = 0; i < n; i++)
+    {
+        int zeroing = is_capture(b, &moves[i]) || is_pawn_move(b, &moves[i]);
+        Snapshot snap;
+        make_move(b, &moves[i], &snap);
+        if (zeroing)
+        {
+            *state = PROBE_OK;
+            dtz = -dtz_before_zeroing(probe_ab(b, 0, state));
+        }
+        else
+            dtz = -probe_dtz(b, state);
+        if (dtz == 1 && is_mate(b))
+            min_dtz = 1;
+        if (!zeroing)
+            dtz += sign_of(dtz);
+        if (dtz < min_dtz && sign_of(dtz) == sign_of(wdl))
+            min_dtz = dtz;
+        undo_move(b, &moves[i], &snap);
+        if (*state == PROBE_FAIL)
+            return 0;
+    }
+    return min_dtz == 0xFFFF ? -1 : min_dtz; // no legal move: mated
+}
+
+int tb_probe_wdl(Board *b, int *ok)
+{
+    int state = PROBE_OK;
+    int wdl = probe_ab(b, 0, &state);
+    *ok = state != PROBE_FAIL;
+    return wdl;
+}
+
+int tb_probe_dtz(Board *b, int *ok)
+{
+    int state;
+    int dtz = probe_dtz(b, &state);
+    *ok = state != PROBE_FAIL;
+    return dtz;
+}
+
+// Any position repeated since the last capture or pawn move
+static int has_repeated(const Board *b)
+{
+    if (!b->game)
+        return 0;
+    const uint64_t *keys = b->game->keys;
+    int last = b->game->size - 1;
+    int first = last - b->rule50 > 0 ? last - b->rule50 : 0;
+    for (int i = last; i - 4 >= first; i--)
+        for (int j = i - 4; j >= first; j -= 2)
+            if (keys[j] == keys[i])
+                return 1;
+    return 0;
+}
+
+int tb_rank_root_moves(Board *b, const Move *moves, int n, int *ranks)
+{
+    int cnt50 = b->rule50;
+    int rep = has_repeated(b);
+    for (int i = 0; i < n; i++)
+    {
+        int state = PROBE_OK, dtz;
+        Snapshot snap;
+        make_move(b, &moves[i], &snap);
+        if (b->rule50 == 0)
+            dtz = dtz_before_zeroing(-probe_ab(b, 0, &state));
+        else if (b->rule50 >= 100 || board_repetitions(b) >= 2)
+            dtz = 0; // the move draws on the spot
+        else
+        {
+            // counted from the root: one more ply
+            dtz = -probe_dtz(b, &state);
+            dtz += sign_of(dtz);
+        }
+        if (dtz == 2 && is_mate(b))
+            dtz = 1;
+        undo_move(b, &moves[i], &snap);
+        if (state == PROBE_FAIL)
+            return 0;
+
+        // Wins that can be converted before the 50-move rule all rank first; losses rank
+        // equally unless the rule might still save the game
+        if (dtz > 0)
+            ranks[i] = dtz + cnt50 <= 99 && !rep ? TB_MAX_DTZ : TB_MAX_DTZ - (dtz + cnt50);
+        else if (dtz < 0)
+            ranks[i] = -dtz * 2 + cnt50 < 100 ? -TB_MAX_DTZ : -TB_MAX_DTZ + (-dtz + cnt50);
+        else
+            ranks[i] = 0;
+    }
+    return 1;
+}
+
+// ---- Self-checks ----
+
+// Positions whose results are beyond doubt, each checked when its table is present. A
+// decoding error or a damaged file shows up here instead of as quietly wrong scores.
+static const struct
+{
+    const char *fen;
+    int wdl;
+} KNOWN_RESULTS[] = {
+    {"8/8/8/4k3/8/8/8/KQ6 w - - 0 1", TB_WIN},       {"8/8/8/4k3/8/8/8/KQ6 b - - 0 1", TB_LOSS},
+    {"8/8/8/4k3/8/8/8/KR6 w - - 0 1", TB_WIN},       {"8/8/8/4k3/8/8/8/KB6 w - - 0 1", TB_DRAW},
+    {"8/8/8/4k3/8/8/8/KN6 b - - 0 1", TB_DRAW},      {"4k3/8/4K3/4P3/8/8/8/8 w - - 0 1", TB_WIN},
+    {"4k3/8/4K3/4P3/8/8/8/8 b - - 0 1", TB_LOSS},    {"k7/8/1K6/P7/8/8/8/8 w - - 0 1", TB_DRAW},
+    {"8/8/8/4k3/8/8/8/KBN5 w - - 0 1", TB_WIN},      {"7k/8/8/8/8/8/8/KQQ5 b - - 0 1", TB_LOSS},
+    {"8/8/8/4k3/8/8/8/KQ4r1 w - - 0 1", TB_WIN},     {"8/8/8/4k3/8/8/8/KQ4r1 b - - 0 1", TB_DRAW},
+    {"8/8/4r3/4k3/8/8/8/KR6 w - - 0 1", TB_DRAW},    {"4k3/8/8/8/8/8/3PP3/4K3 w - - 0 1", TB_WIN},
+    {"8/8/8/8/8/8/2k1p3/K3R3 w - - 0 1", TB_WIN},
+};
+
+static int check_known_results(void)
+{
+    for (size_t i = 0; i < sizeof(KNOWN_RESULTS) / sizeof(KNOWN_RESULTS[0]); i++)
+    {
+        Board b;
+        board_set_fen(&b, KNOWN_RESULTS[i].fen);
+        int ok, dtz_ok;
+        int wdl = tb_probe_wdl(&b, &ok);
+        if (!ok)
+            continue; // table not installed
+        int dtz = tb_probe_dtz(&b, &dtz_ok);
+        if (wdl != KNOWN_RESULTS[i].wdl || (dtz_ok && sign_of(dtz) != sign_of(wdl)))
+        {
+            fprintf(stderr, "tb: %s probes as WDL %d DTZ %d, expected WDL %d\n", KNOWN_RESULTS[i].fen, wdl,
+                    dtz_ok ? dtz : 0, KNOWN_RESULTS[i].wdl);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// tbcheck DIRS BITBASE_FILE [positions]: probe random positions of every ending the
+// bitbases cover and compare. The bitbases know nothing of the 50-move rule, so cursed
+// wins count as wins and blessed losses as losses.
+int tb_check_command(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        printf("usage: tbcheck DIRS BITBASE_FILE [positions]\n");
+        return 1;
+    }
+    if (!tb_init(argv[1]))
+    {
+        printf("No usable Syzygy tables in %s\n", argv[1]);
+        return 1;
+    }
+    if (!bitbase_open(argv[2]))
+    {
+        printf("Cannot open bitbases %s\n", argv[2]);
+        return 1;
+    }
+    int samples = argc > 3 ? atoi(argv[3]) : 100000;
+
+    static const char *ENDINGS[] = {"KQvK", "KRvK", "KPvK", "KBNvK", "KQvKR", "KRvKR", "KRvKB", "KRvKN", "KRvKP"};
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    int failed = 0;
+    for (size_t e = 0; e < sizeof(ENDINGS) / sizeof(ENDINGS[0]); e++)
+    {
+        int probed = 0, wdl_errors = 0, dtz_errors = 0;
+        for (int s = 0; s < samples; s++)
+        {
+            // Scatter the pieces, either side taking the stronger half; pawns stay off the
+            // back ranks and the side not to move must not be in check
+            char grid[64];
+            memset(grid, 0, sizeof(grid));
+            int strong = (int)(rng & 1), color = strong;
+            for (const char *p = ENDINGS[e]; *p; p++)
+            {
+                if (*p == 'v')
+                {
+                    color = !strong;
+                    continue;
+                }
+                int sq;
+                do
+                {
+                    rng ^= rng << 13;
+                    rng ^= rng >> 7;
+                    rng ^= rng << 17;
+                    sq = (int)(rng % 64);
+                } while (grid[sq] || (*p == 'P' && (sq < 8 || sq >= 56)));
+                grid[sq] = color == WHITE ? *p : (char)(*p - 'A' + 'a');
+            }
+
+            char fen[100];
+            int len = 0;
+            for (int r = 0; r < 8; r++)
+            {
+                int empty = 0;
+                for (int f = 0; f < 8; f++)
+                {
+                    char c = grid[r * 8 + f];
+                    if (!c)
+                    {
+                        empty++;
+                        continue;
+                    }
+                    if (empty)
+                        fen[len++] = (char)('0' + empty);
+                    empty = 0;
+                    fen[len++] = c;
+                }
+                if (empty)
+                    fen[len++] = (char)('0' + empty);
+                fen[len++] = r < 7 ? '/' : ' ';
+            }
+            snprintf(fen + len, sizeof(fen) - len, "%c - - 0 1", rng & 2 ? 'w' : 'b');
+
+            Board b;
+            board_set_fen(&b, fen);
+            if (is_square_attacked(&b, b.king_sq[b.side ^ 1], b.side))
+                continue;
+            int ok, dtz_ok, bb_wdl;
+            int wdl = tb_probe_wdl(&b, &ok);
+            int dtz = tb_probe_dtz(&b, &dtz_ok);
+            if (!ok || !bitbase_probe(&b, &bb_wdl))
+                break; // ending not installed
+            probed++;
+            if (sign_of(wdl) != bb_wdl)
+            {
+                if (wdl_errors++ < 5)
+                    printf("  %s: tables %d, bitbases %d\n", fen, wdl, bb_wdl);
+            }
+            else if (dtz_ok && sign_of(dtz) != sign_of(wdl))
+            {
+                if (dtz_errors++ < 5)
+                    printf("  %s: WDL %d but DTZ %d\n", fen, wdl, dtz);
+            }
+        }
+        if (probed)
+            printf("%-6s %8d positions, %d WDL and %d DTZ mismatches\n", ENDINGS[e], probed, wdl_errors, dtz_errors);
+        else
+            printf("%-6s skipped, table not found\n", ENDINGS[e]);
+        failed |= wdl_errors || dtz_errors;
+    }
+    bitbase_close();
+    tb_free();
+    return failed;
+}
@@ -0,0 +1,41 @@
+#ifndef TB_H
+#define TB_H
+#include "board.h"
+
+// Syzygy endgame tablebases read from local files: .rtbw (win/draw/loss) and .rtbz
+// (distance to the next capture or pawn move). Only the file names are checked by
+// tb_init; each table is memory-mapped the first time a position with its material
+// is probed.
+
+// Probe results from the side to move's point of view. Cursed wins and blessed losses
+// are wins and losses that the 50-move rule turns into draws.
+enum
+{
+    TB_LOSS = -2,
+    TB_BLESSED_LOSS = -1,
+    TB_DRAW = 0,
+    TB_CURSED_WIN = 1,
+    TB_WIN = 2
+};
+
+int tb_init(const char *paths); // directories separated by ':' (';' on Windows); returns tb_largest()
+void tb_free(void);
+int tb_largest(void); // most pieces (kings included) of any table found, 0 = none
+void tb_set_rule50(int on); // score cursed wins and blessed losses as draws (default on)
+int tb_rule50(void);
+void tb_set_probe_depth(int depth); // search probes need this much remaining depth at the largest piece count
+int tb_probe_depth(void);
+
+// Both need the side to move without castling rights; *ok is 0 when a table is missing
+int tb_probe_wdl(Board *b, int *ok);
+int tb_probe_dtz(Board *b, int *ok); // plies to zeroing, signed like the WDL result; 0 = draw
+
+// Rank the legal root moves from the DTZ tables, higher is better: winning moves that
+// stay clear of the 50-move rule share the top rank. 0 if any probe failed.
+int tb_rank_root_moves(Board *b, const Move *moves, int n, int *ranks);
+
+// tbcheck DIRS BITBASE_FILE [positions]: compare the tables with the bitbases on random
+// positions; nonzero if they disagree anywhere
+int tb_check_command(int argc, char **argv);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,242 @@
+#include "tt.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Stored form: 16 bytes, so a bucket is one 64-byte cache line. The table is shared by all
+// search threads without locks: the check word is key ^ data, so a slot torn by two
+// concurrent writers fails verification on probe and reads as a miss instead of returning
+// one position's score with another's key.
+typedef struct
+{
+    uint64_t check;
+    uint64_t data; // score (16 bits) | depth << 16 | bound << 24 | age << 32 | from << 40 | to << 48 | promo << 56
+} TTSlot;
+
+struct TTable
+{
+    TTSlot *slots;
+    size_t bucket_mask; // number of buckets - 1 (power of two)
+    unsigned char generation;
+};
+
+// The table behind tt_probe / tt_store: searches without a private table share it
+static TTable shared;
+
+static uint64_t pack_data(const TTEntry *e)
+{
+    return (uint64_t)(uint16_t)e->score | (uint64_t)(unsigned char)e->depth << 16 | (uint64_t)e->bound << 24 |
+           (uint64_t)e->age << 32 | (uint64_t)e->from_sq << 40 | (uint64_t)e->to_sq << 48 |
+           (uint64_t)(unsigned char)e->promo << 56;
+}
+
+// Copy a slot out; returns 0 for empty or torn slots
+static int load_slot(const TTSlot *slot, TTEntry *e)
+{
+    uint64_t check = __atomic_load_n(&slot->check, __ATOMIC_RELAXED);
+    uint64_t data = __atomic_load_n(&slot->data, __ATOMIC_RELAXED);
+    e->key = check ^ data;
+    e->score = (int16_t)(data & 0xFFFF);
+    e->depth = (signed char)(data >> 16);
+    e->bound = (unsigned char)(data >> 24);
+    e->age = (unsigned char)(data >> 32);
+    e->from_sq = (unsigned char)(data >> 40);
+    e->to_sq = (unsigned char)(data >> 48);
+    e->promo = (char)(data >> 56);
+    return e->bound != TT_NONE && e->bound <= TT_UPPER;
+}
+
+static void save_slot(TTSlot *slot, const TTEntry *e)
+{
+    uint64_t data = pack_data(e);
+    __atomic_store_n(&slot->data, data, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->check, e->key ^ data, __ATOMIC_RELAXED);
+}
+
+void tt_table_resize(TTable *t, size_t mb)
+{
+    size_t buckets = 1;
+    size_t bytes = mb * 1024 * 1024;
+    while (buckets * 2 * TT_BUCKET * sizeof(TTSlot) <= bytes)
+        buckets *= 2;
+
+    free(t->slots);
+    t->slots = (TTSlot *)calloc(buckets * TT_BUCKET, sizeof(TTSlot));
+    if (!t->slots)
+    {
+        // fall back to a single bucket rather than searching without a table
+        buckets = 1;
+        t->slots = (TTSlot *)calloc(TT_BUCKET, sizeof(TTSlot));
+    }
+    t->bucket_mask = buckets - 1;
+    t->generation = 0;
+}
+
+void tt_table_clear(TTable *t)
+{
+    if (t->slots)
+        memset(t->slots, 0, (t->bucket_mask + 1) * TT_BUCKET * sizeof(TTSlot));
+    t->generation = 0;
+}
+
+TTable *tt_table_new(size_t mb)
+{
+    TTable *t = (TTable *)calloc(1, sizeof(TTable));
+    if (t)
+        tt_table_resize(t, mb);
+    return t;
+}
+
+void tt_table_free(TTable *t)
+{
+    if (!t || t == &shared)
+        return;
+    free(t->slots);
+    free(t);
+}
+
+TTable *tt_shared(void)
+{
+    return &shared;
+}
+
+void tt_init(void)
+{
+    if (!shared.slots)
+        tt_table_resize(&shared, TT_DEFAULT_MB);
+}
+
+// Called once per search, before any thread starts: entries from older searches become preferred
+// victims. Concurrent searches (batch analysis) share the counter of the shared table.
+void tt_table_new_search(TTable *t)
+{
+    if (t == &shared)
+        tt_init();
+    __atomic_add_fetch(&t->generation, 1, __ATOMIC_RELAXED);
+}
+
+static unsigned char current_generation(const TTable *t)
+{
+    return __atomic_load_n(&t->generation, __ATOMIC_RELAXED);
+}
+
+int tt_table_probe(TTable *t, uint64_t key, TTEntry *out)
+{
+    if (!t->slots)
+        return 0;
+    TTSlot *bucket = &t->slots[(key & t->bucket_mask) * TT_BUCKET];
+    for (int i = 0; i < TT_BUCKET; i++)
+    {
+        if (load_slot(&bucket[i], out) && out->key == key)
+        {
+            if (out->age != current_generation(t))
+            {
+                out->age = current_generation(t); // still useful in this search
+                save_slot(&bucket[i], out);
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void tt_table_store(TTable *t, uint64_t key, int depth, int bound, int score, const Move *best)
+{
+    if (!t->slots)
+        return;
+    TTSlot *bucket = &t->slots[(key & t->bucket_mask) * TT_BUCKET];
+    TTSlot *slot = NULL;
+    TTEntry old;
+    int found = 0;
+
+    for (int i = 0; i < TT_BUCKET; i++)
+    {
+        int valid = load_slot(&bucket[i], &old);
+        if (!valid || old.key == key)
+        {
+            slot = &bucket[i];
+            found = valid;
+            break;
+        }
+    }
+    if (!slot)
+    {
+        // Replace the shallowest entry, counting each generation of age as 8 plies
+        int worst = 1 << 30;
+        for (int i = 0; i < TT_BUCKET; i++)
+        {
+            TTEntry e;
+            load_slot(&bucket[i], &e);
+            int stale = (unsigned char)(current_generation(t) - e.age);
+            int value = e.depth - 8 * stale;
+            if (value < worst)
+            {
+                worst = value;
+                slot = &bucket[i];
+            }
+        }
+    }
+    else if (found && old.age == current_generation(t) && bound != TT_EXACT && depth + 2 < old.depth)
+    {
+        // Keep a much deeper result for the same position from this search
+        return;
+    }
+
+    TTEntry e;
+    e.key = key;
+    e.score = score;
+    e.depth = (signed char)depth;
+    e.bound = (unsigned char)bound;
+    e.age = current_generation(t);
+    if (best)
+    {
+        e.from_sq = (unsigned char)SQ(best->from_x, best->from_y);
+        e.to_sq = (unsigned char)SQ(best->to_x, best->to_y);
+        e.promo = best->promo;
+    }
+    else if (found)
+    {
+        e.from_sq = old.from_sq;
+        e.to_sq = old.to_sq;
+        e.promo = old.promo;
+    }
+    else
+    {
+        e.from_sq = e.to_sq = 0;
+        e.promo = 0;
+    }
+    save_slot(slot, &e);
+}
+
+void tt_resize(size_t mb)
+{
+    tt_table_resize(&shared, mb);
+}
+
+void tt_clear(void)
+{
+    tt_table_clear(&shared);
+}
+
+void tt_new_search(void)
+{
+    tt_table_new_search(&shared);
+}
+
+int tt_probe(uint64_t key, TTEntry *out)
+{
+    return tt_table_probe(&shared, key, out);
+}
+
+void tt_store(uint64_t key, int depth, int bound, int score, const Move *best)
+{
+    tt_table_store(&shared, key, depth, bound, score, best);
+}
+
+int tt_entry_move(const TTEntry *e, Move *out)
+{
+    if (e->from_sq == e->to_sq)
+        return 0;
+    *out = (Move){.from_x = SQ_X(e->from_sq), .from_y = SQ_Y(e->from_sq),
+                  .to_x = SQ_X(e->to_sq), .to_y = SQ_Y(e->to_sq), .promo = e->promo};
+    return 1;
+}
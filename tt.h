@@ -0,0 +1,49 @@
+#ifndef TT_H
+#define TT_H
+#include "board.h"
+
+#define TT_DEFAULT_MB 16
+#define TT_BUCKET 4 // entries sharing one index; replacement picks among them
+
+enum
+{
+    TT_NONE,
+    TT_EXACT, // score is the true minimax value
+    TT_LOWER, // search failed high: true value >= score
+    TT_UPPER  // search failed low:  true value <= score
+};
+
+// Decoded entry, as copied out by tt_probe
+typedef struct
+{
+    uint64_t key;
+    int score;             // centipawns; mate scores counted from this node, not the root
+    signed char depth;     // remaining depth the entry was searched with (0 = quiescence)
+    unsigned char bound;   // TT_EXACT / TT_LOWER / TT_UPPER
+    unsigned char age;     // search generation that last wrote or hit the entry
+    unsigned char from_sq; // best move (from_sq == to_sq means none)
+    unsigned char to_sq;
+    char promo;
+} TTEntry;
+
+// The shared table, used by every search without a table of its own
+void tt_resize(size_t mb);
+void tt_clear(void);
+void tt_init(void); // allocate the default size if no table exists yet
+void tt_new_search(void);
+int tt_probe(uint64_t key, TTEntry *out);
+void tt_store(uint64_t key, int depth, int bound, int score, const Move *best);
+int tt_entry_move(const TTEntry *e, Move *out);
+
+// Separate tables, e.g. one per engine of a match so they do not read each other's results
+typedef struct TTable TTable;
+TTable *tt_shared(void);
+TTable *tt_table_new(size_t mb);
+void tt_table_free(TTable *t); // the shared table is never freed
+void tt_table_resize(TTable *t, size_t mb);
+void tt_table_clear(TTable *t);
+void tt_table_new_search(TTable *t);
+int tt_table_probe(TTable *t, uint64_t key, TTEntry *out);
+void tt_table_store(TTable *t, uint64_t key, int depth, int bound, int score, const Move *best);
+
+#endif
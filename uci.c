@@ -0,0 +1,339 @@
+#include "uci.h"
+#include "ai.h"
+#include "tt.h"
+#include "book.h"
+#include "tb.h"
+#include "bitbase.h"
+#include "util.h"
+#include <pthread.h>
+
+// UCI front end: the position and the search live here, the GUI drives them over stdin/stdout.
+// "go" runs the search on its own thread so "stop", "isready" and "quit" are read meanwhile.
+
+static Board board;
+static GameRecord game;
+static int root_side;
+
+static SearchLimits go_limits;
+static int go_infinite;
+static pthread_t search_thread;
+static int searching = 0;
+static int search_done = 0;    // set by the search thread, read with atomics
+static int stop_requested = 0; // "stop" or "quit" seen, read with atomics
+
+// ctx: the side to move at the root
+static void print_info(const SearchResult *r, void *ctx)
+{
+    char buf[8];
+    int score = *(const int *)ctx == WHITE ? r->score : -r->score;
+
+    printf("info depth %d score ", r->depth);
+    if (abs(score) >= MATE_BOUND)
+    {
+        int plies = MATE_SCORE - abs(score);
+        printf("mate %d", score > 0 ? (plies + 1) / 2 : -(plies / 2));
+    }
+    else
+    {
+        printf("cp %d", score);
+    }
+    printf(" nodes %llu nps %llu time %lld pv", (unsigned long long)r->nodes,
+           (unsigned long long)(r->time_ms > 0 ? r->nodes * 1000 / (uint64_t)r->time_ms : 0), r->time_ms);
+    for (int i = 0; i < r->pv_length; i++)
+    {
+        format_move(&r->pv[i], buf);
+        printf(" %s", buf);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static void *search_main(void *arg)
+{
+    (void)arg;
+    SearchResult result;
+    int found = search_position(&board, color_char(root_side), &go_limits, &result);
+
+    // "go infinite" must not answer before the GUI says "stop"
+    while (go_infinite && !__atomic_load_n(&stop_requested, __ATOMIC_RELAXED))
+        sleep_ms(1);
+
+    char buf[8] = "0000";
+    if (found)
+        format_move(&result.best, buf);
+    printf("bestmove %s\n", buf);
+    fflush(stdout);
+    __atomic_store_n(&search_done, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// Stop and join a running search. The stop is repeated until the thread finishes, so it
+// cannot be lost to a search that had not yet started when "stop" arrived.
+static void wait_search(int stop)
+{
+    if (!searching)
+        return;
+    if (stop)
+        __atomic_store_n(&stop_requested, 1, __ATOMIC_RELAXED);
+    while (stop && !__atomic_load_n(&search_done, __ATOMIC_RELAXED))
+    {
+        search_stop();
+        sleep_ms(1);
+    }
+    pthread_join(search_thread, NULL);
+    searching = 0;
+}
+
+// position [startpos | fen <fen>] [moves <m1> <m2> ...]
+static void uci_position(char *args)
+{
+    char *moves = strstr(args, "moves");
+    if (moves)
+    {
+        *moves = 0; // ends the FEN
+        moves += 5;
+    }
+
+    if (strncmp(args, "fen", 3) == 0)
+    {
+        if (!board_set_fen(&board, args + 3))
+        {
+            printf("info string invalid fen, using the start position\n");
+            board_set_fen(&board, STARTPOS_FEN);
+        }
+    }
+    else
+    {
+        board_set_fen(&board, STARTPOS_FEN);
+    }
+    board_attach_game(&board, &game);
+
+    for (char *tok = moves ? strtok(moves, " \t\r\n") : NULL; tok; tok = strtok(NULL, " \t\r\n"))
+    {
+        Move m;
+        if (!parse_move(&board, tok, &m))
+        {
+            printf("info string illegal move %s\n", tok);
+            break;
+        }
+        board_play_move(&board, &m);
+    }
+}
+
+// Share of the remaining clock to spend on this move
+static long long time_budget(long long time_left, long long inc, int moves_to_go)
+{
+    if (moves_to_go <= 0)
+        moves_to_go = 30;
+    long long budget = time_left / moves_to_go + inc * 3 / 4;
+    if (budget > time_left - 50)
+        budget = time_left - 50;
+    return budget > 1 ? budget : 1;
+}
+
+// go [depth N] [movetime MS] [nodes N] [wtime MS btime MS winc MS binc MS movestogo N] [infinite]
+static void uci_go(char *args)
+{
+    long long time_left[2] = {-1, -1}, inc[2] = {0, 0};
+    int moves_to_go = 0;
+
+    memset(&go_limits, 0, sizeof(go_limits));
+    go_limits.report = print_info;
+    go_limits.ctx = &root_side;
+    go_infinite = 0;
+    for (char *tok = strtok(args, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n"))
+    {
+        char *val = NULL;
+        if (strcmp(tok, "infinite") == 0)
+        {
+            go_infinite = 1;
+            continue;
+        }
+        if (strcmp(tok, "ponder") == 0 || !(val = strtok(NULL, " \t\r\n")))
+            continue;
+        if (strcmp(tok, "depth") == 0)
+            go_limits.depth = atoi(val);
+        else if (strcmp(tok, "movetime") == 0)
+            go_limits.movetime_ms = atoll(val);
+        else if (strcmp(tok, "nodes") == 0)
+            go_limits.nodes = strtoull(val, NULL, 10);
+        else if (strcmp(tok, "wtime") == 0)
+            time_left[WHITE] = atoll(val);
+        else if (strcmp(tok, "btime") == 0)
+            time_left[BLACK] = atoll(val);
+        else if (strcmp(tok, "winc") == 0)
+            inc[WHITE] = atoll(val);
+        else if (strcmp(tok, "binc") == 0)
+            inc[BLACK] = atoll(val);
+        else if (strcmp(tok, "movestogo") == 0)
+            moves_to_go = atoi(val);
+    }
+
+    // A book move is answered at once, except when the GUI asked to analyse
+    Move book_move;
+    if (!go_infinite && book_probe(&board, &book_move))
+    {
+        char buf[8];
+        format_move(&book_move, buf);
+        printf("bestmove %s\n", buf);
+        return;
+    }
+
+    root_side = board.side;
+    // A budget taken from the clock may be left unspent: the search stops early once an
+    // iteration ends past half of it. An explicit movetime is used in full.
+    if (!go_infinite && !go_limits.movetime_ms && time_left[root_side] >= 0)
+    {
+        go_limits.movetime_ms = time_budget(time_left[root_side], inc[root_side], moves_to_go);
+        go_limits.soft_ms = go_limits.movetime_ms / 2;
+    }
+
+    search_done = 0;
+    stop_requested = 0;
+    if (pthread_create(&search_thread, NULL, search_main, NULL) == 0)
+        searching = 1;
+    else
+        search_main(NULL);
+}
+
+// setoption name <Hash|Threads|Contempt|BookFile|BookDepth|BookBestMove|SyzygyPath|SyzygyProbeDepth|Syzygy50MoveRule|
+//                BitbaseFile> value <v>
+static void uci_setoption(char *args)
+{
+    char *name = strstr(args, "name ");
+    char *value = strstr(args, " value ");
+    if (!name || !value)
+        return;
+    name += 5;
+    *value = 0;
+    value += 7;
+    value[strcspn(value, "\r\n")] = 0;
+    int n = atoi(value);
+    if (strcmp(name, "Hash") == 0 && n > 0)
+        tt_resize((size_t)n);
+    else if (strcmp(name, "Threads") == 0)
+        search_set_threads(n);
+    else if (strcmp(name, "Contempt") == 0)
+        search_set_contempt(n);
+    else if (strcmp(name, "BookFile") == 0)
+    {
+        if (strcmp(value, "<empty>") == 0 || !*value)
+            book_close();
+        else if (!book_open(value))
+            printf("info string cannot open book %s\n", value);
+    }
+    else if (strcmp(name, "BookDepth") == 0)
+        book_set_max_ply(n);
+    else if (strcmp(name, "BookBestMove") == 0)
+        book_set_mode(strcmp(value, "true") == 0 ? BOOK_BEST : BOOK_WEIGHTED);
+    else if (strcmp(name, "SyzygyPath") == 0)
+    {
+        int pieces = tb_init(value);
+        if (pieces)
+            printf("info string tablebases found up to %d pieces\n", pieces);
+        else if (strcmp(value, "<empty>") != 0 && *value)
+            printf("info string no tablebases found in %s\n", value);
+    }
+    else if (strcmp(name, "SyzygyProbeDepth") == 0)
+        tb_set_probe_depth(n);
+    else if (strcmp(name, "Syzygy50MoveRule") == 0)
+        tb_set_rule50(strcmp(value, "true") == 0);
+    else if (strcmp(name, "BitbaseFile") == 0)
+    {
+        // Only an existing file is opened: building one takes far too long to block the
+        // command loop, so that is a separate step
+        if (strcmp(value, "<empty>") == 0 || !*value)
+            bitbase_close();
+        else if (bitbase_open(value))
+            printf("info string bitbases loaded from %s\n", value);
+        else
+            printf("info string cannot open bitbases %s, build them with: chess bitbases %s\n", value, value);
+    }
+}
+
+// Handle one command line; returns 0 on "quit"
+static int uci_command(char *line)
+{
+    line[strcspn(line, "\r\n")] = 0;
+    char *args = strchr(line, ' ');
+    if (args)
+        *args++ = 0;
+    else
+        args = line + strlen(line);
+
+    if (strcmp(line, "uci") == 0)
+    {
+        printf("id name C Chess Engine\n");
+        printf("id author Matin (k3rn3lpanic)\n");
+        printf("option name Hash type spin default %d min 1 max 65536\n", TT_DEFAULT_MB);
+        printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+        printf("option name Contempt type spin default 0 min -100 max 100\n");
+        printf("option name BookFile type string default <empty>\n");
+        printf("option name BookDepth type spin default 0 min 0 max 1000\n");
+        printf("option name BookBestMove type check default false\n");
+        printf("option name SyzygyPath type string default <empty>\n");
+        printf("option name SyzygyProbeDepth type spin default 1 min 1 max 100\n");
+        printf("option name Syzygy50MoveRule type check default true\n");
+        printf("option name BitbaseFile type string default <empty>\n");
+        printf("uciok\n");
+    }
+    else if (strcmp(line, "isready") == 0)
+    {
+        printf("readyok\n");
+    }
+    else if (strcmp(line, "ucinewgame") == 0)
+    {
+        wait_search(1);
+        tt_clear();
+        search_new_game();
+    }
+    else if (strcmp(line, "setoption") == 0)
+    {
+        wait_search(1);
+        uci_setoption(args);
+    }
+    else if (strcmp(line, "position") == 0)
+    {
+        wait_search(1);
+        uci_position(args);
+    }
+    else if (strcmp(line, "go") == 0)
+    {
+        wait_search(1);
+        uci_go(args);
+    }
+    else if (strcmp(line, "stop") == 0)
+    {
+        wait_search(1);
+    }
+    else if (strcmp(line, "quit") == 0)
+    {
+        return 0;
+    }
+    fflush(stdout);
+    return 1;
+}
+
+// first_line: a command already read by the caller (the CLI's first prompt), or NULL
+int uci_loop(const char *first_line)
+{
+    char line[8192];
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    board_set_fen(&board, STARTPOS_FEN);
+    game_init(&game);
+    board_attach_game(&board, &game);
+
+    int running = 1;
+    if (first_line)
+    {
+        snprintf(line, sizeof(line), "%s", first_line);
+        running = uci_command(line);
+    }
+    while (running && fgets(line, sizeof(line), stdin))
+        running = uci_command(line);
+
+    wait_search(1);
+    game_free(&game);
+    return 0;
+}
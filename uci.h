@@ -0,0 +1,7 @@
+#ifndef UCI_H
+#define UCI_H
+#include "board.h"
+
+int uci_loop(const char *first_line);
+
+#endif
\ No newline at end of file
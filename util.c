@@ -1,55 +1,8 @@
 #include "util.h"
+#include "move_gen.h"
 #include <stdio.h>
 #include <string.h>
 
-void position_key(Board *b, char color_to_move, char *out, size_t out_sz)
-{
-    // Serialize board + side + castling flags
-    char *p = out;
-    size_t rem = out_sz;
-    for (int i = 0; i < 8; i++)
-    {
-        for (int j = 0; j < 8; j++)
-        {
-            Cell c = b->cells[i][j];
-            char color = (c.state == 'W' || c.state == 'B') ? c.state : '.';
-            char piece = c.piece ? c.piece : '.';
-            int n = snprintf(p, rem, "%c%c", color, piece);
-            p += n;
-            rem -= (size_t)n;
-            if (rem <= 1)
-                goto finish;
-        }
-    }
-    snprintf(p, rem, "|%c|W%sQ%sB%sq%s",
-             color_to_move,
-             b->castling_W_K ? "K" : "-",
-             b->castling_W_Q ? "Q" : "-",
-             b->castling_B_K ? "K" : "-",
-             b->castling_B_Q ? "Q" : "-");
-finish:
-    out[out_sz - 1] = 0;
-}
-
-void history_increment(Board *b, const char *key)
-{
-    for (int i = 0; i < b->history_size; i++)
-    {
-        if (strcmp(b->history[i].key, key) == 0)
-        {
-            b->history[i].count += 1;
-            return;
-        }
-    }
-    if (b->history_size < (int)(sizeof(b->history) / sizeof(b->history[0])))
-    {
-        strncpy(b->history[b->history_size].key, key, sizeof(b->history[0].key) - 1);
-        b->history[b->history_size].key[sizeof(b->history[0].key) - 1] = 0;
-        b->history[b->history_size].count = 1;
-        b->history_size++;
-    }
-}
-
 char piece_symbol(char piece, char color)
 {
     // Unicode chess glyphs
@@ -161,7 +114,7 @@ void board_draw(Board *b, Pos *highlights, int n_highlights)
 
         for (int j = 0; j < 8; j++)
         {
-            Cell c = b->cells[i][j];
+            Cell c = board_cell(b, i, j);
             int hl = pos_in_list(highlights, n_highlights, i, j);
 
             // Determine if square is light or dark
@@ -364,6 +317,141 @@ void format_square(int x, int y, char *out)
     out[2] = 0;
 }
 
+// Coordinate notation as used by UCI: e2e4, e7e8q
+void format_move(const Move *m, char *out)
+{
+    format_square(m->from_x, m->from_y, out);
+    format_square(m->to_x, m->to_y, out + 2);
+    out[4] = m->promo ? (char)tolower((unsigned char)m->promo) : 0;
+    out[5] = 0;
+}
+
+// Parse coordinate notation into one of the side to move's legal moves
+int parse_move(Board *b, const char *s, Move *out)
+{
+    Move m = {0};
+    if (!parse_square(s, &m.from_x, &m.from_y) || !parse_square(s + 2, &m.to_x, &m.to_y))
+        return 0;
+    if (s[4] && !isspace((unsigned char)s[4]))
+        m.promo = (char)toupper((unsigned char)s[4]);
+
+    Move moves[256];
+    int n = 0;
+    generate_legal_moves(b, b->side, ~0ULL, 1, moves, &n);
+    for (int i = 0; i < n; i++)
+    {
+        if (move_equal(&moves[i], &m))
+        {
+            *out = moves[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Standard algebraic notation: Nbd7, exd5, e8=Q+, O-O-O#
+void format_san(Board *b, const Move *m, char *out)
+{
+    int from = SQ(m->from_x, m->from_y), to = SQ(m->to_x, m->to_y);
+    int type = piece_type(b->squares[from]);
+    int capture = b->squares[to] != NO_PIECE || (type == PAWN && m->from_y != m->to_y);
+    char *p = out;
+
+    if (type == KING && abs(m->to_y - m->from_y) == 2)
+        p += sprintf(p, m->to_y > m->from_y ? "O-O" : "O-O-O");
+    else
+    {
+        if (type == PAWN)
+        {
+            if (capture)
+                *p++ = (char)('a' + m->from_y);
+        }
+        else
+        {
+            *p++ = PIECE_CHARS[type];
+            // Disambiguate from the other pieces of this type that can reach the square
+            Move moves[256];
+            int n = 0, others = 0, same_file = 0, same_rank = 0;
+            generate_legal_moves(b, b->side, BIT(to), 0, moves, &n);
+            for (int i = 0; i < n; i++)
+            {
+                int f = SQ(moves[i].from_x, moves[i].from_y);
+                if (f == from || piece_type(b->squares[f]) != type)
+                    continue;
+                others++;
+                same_file += moves[i].from_y == m->from_y;
+                same_rank += moves[i].from_x == m->from_x;
+            }
+            if (others && (!same_file || same_rank))
+                *p++ = (char)('a' + m->from_y);
+            if (others && same_file)
+                *p++ = (char)('0' + 8 - m->from_x);
+        }
+        if (capture)
+            *p++ = 'x';
+        format_square(m->to_x, m->to_y, p);
+        p += 2;
+        if (m->promo)
+        {
+            *p++ = '=';
+            *p++ = m->promo;
+        }
+    }
+
+    // Check and mate
+    Snapshot snap;
+    make_move(b, m, &snap);
+    if (is_square_attacked(b, b->king_sq[b->side], !b->side))
+    {
+        Move replies[256];
+        int n = 0;
+        generate_legal_moves(b, b->side, ~0ULL, 1, replies, &n);
+        *p++ = n ? '+' : '#';
+    }
+    undo_move(b, m, &snap);
+    *p = 0;
+}
+
+// Length of a SAN move without check marks and annotations; 0-0 counts as O-O
+static size_t san_core(const char *s, char *out, size_t n)
+{
+    size_t len = 0;
+    for (; *s && !isspace((unsigned char)*s) && !strchr("+#!?;,", *s) && len + 1 < n; s++)
+        out[len++] = *s == '0' ? 'O' : *s;
+    out[len] = 0;
+    return len;
+}
+
+// Parse SAN (or, failing that, coordinate notation) into one of the side to move's legal moves
+int parse_san(Board *b, const char *s, Move *out)
+{
+    char want[16], have[16], san[16];
+    if (!san_core(s, want, sizeof(want)))
+        return 0;
+    Move moves[256];
+    int n = 0;
+    generate_legal_moves(b, b->side, ~0ULL, 1, moves, &n);
+    for (int i = 0; i < n; i++)
+    {
+        format_san(b, &moves[i], san);
+        san_core(san, have, sizeof(have));
+        // Promotions are also accepted without the '=' (e8Q)
+        char *eq = strchr(have, '=');
+        int match = strcmp(have, want) == 0;
+        if (!match && eq)
+        {
+            memmove(eq, eq + 1, strlen(eq));
+            match = strcmp(have, want) == 0;
+        }
+        if (match)
+        {
+            *out = moves[i];
+            return 1;
+        }
+    }
+    return parse_move(b, s, out);
+}
+
 int input_line(char *buf, size_t n)
 {
     if (!fgets(buf, (int)n, stdin))
@@ -381,4 +469,25 @@ void clear_console()
 #else
     system("clear");
 #endif
-}
\ No newline at end of file
+}
+
+// Monotonic wall clock in milliseconds, for timing searches and perft
+long long now_ms(void)
+{
+#ifdef _WIN32
+    return (long long)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+void sleep_ms(int ms)
+{
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec ts = {ms / 1000, (long)(ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+#endif
+}
@@ -10,15 +10,19 @@
 #ifdef _WIN32
 #include <windows.h>
 #endif
-void position_key(Board *b, char color_to_move, char *out, size_t out_sz);
-void history_increment(Board *b, const char *key);
 int input_line(char *buf, size_t n);
 void format_square(int x, int y, char *out);
 int parse_square(const char *s, int *out_x, int *out_y);
+void format_move(const Move *m, char *out);
+int parse_move(Board *b, const char *s, Move *out);
+void format_san(Board *b, const Move *m, char *out); // out: at least 8 characters
+int parse_san(Board *b, const char *s, Move *out);
 void board_draw(Board *b, Pos *highlights, int n_highlights);
 int pos_in_list(Pos *list, int n, int x, int y);
 const char *piece_unicode(char piece, char color);
 char piece_symbol(char piece, char color);
 void clear_console();
+long long now_ms(void);
+void sleep_ms(int ms);
 
 #endif
\ No newline at end of file